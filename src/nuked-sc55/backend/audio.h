@@ -1,8 +1,10 @@
 #pragma once
 
 #include "math_util.h"
+#include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <span>
 
 enum class AudioFormat
 {
@@ -40,6 +42,25 @@ inline void Normalize(const AudioFrame<int32_t>& in, AudioFrame<float>& out)
     out.right = (float)in.right * DIV_REC;
 }
 
+// Block version of the above. Treats the frames as one flat array of samples so that the loop vectorizes.
+inline void Normalize(std::span<const AudioFrame<int32_t>> in, std::span<AudioFrame<float>> out)
+{
+    constexpr float DIV_REC = 1.0f / 536870912.0f;
+
+    static_assert(sizeof(AudioFrame<int32_t>) == 2 * sizeof(int32_t));
+    static_assert(sizeof(AudioFrame<float>) == 2 * sizeof(float));
+    assert(out.size() >= in.size());
+
+    const int32_t* src = (const int32_t*)in.data();
+    float* dst         = (float*)out.data();
+    const size_t count = in.size() * AudioFrame<int32_t>::channel_count;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = (float)src[i] * DIV_REC;
+    }
+}
+
 inline void MixFrame(AudioFrame<int16_t>& dest, const AudioFrame<int16_t>& src)
 {
     dest.left  = SaturatingAdd(dest.left, src.left);
@@ -36,40 +36,100 @@
 #include "lcd.h"
 #include "mcu.h"
 #include "mcu_timer.h"
+#include "pages.h"
 #include "pcm.h"
+#include "rom_store.h"
+#include "state.h"
 #include "submcu.h"
 #include <bit>
 #include <fstream>
 #include <span>
 #include <vector>
 
+// Components start on their own cache lines
+static const size_t EMU_ARENA_ALIGN = 64;
+
+// Reserves room for a T at the end of an arena of `size` bytes and returns its offset.
+template <typename T>
+static size_t EMU_ArenaSlot(size_t& size)
+{
+    static_assert(alignof(T) <= EMU_ARENA_ALIGN);
+    const size_t offset = (size + EMU_ARENA_ALIGN - 1) & ~(EMU_ARENA_ALIGN - 1);
+    size = offset + sizeof(T);
+    return offset;
+}
+
+void Emulator::ArenaFree::operator()(void* ptr) const
+{
+    FreePages(ptr, size, false);
+}
+
 Emulator::~Emulator()
 {
     SaveNVRAM();
 }
 
-bool Emulator::Init(const EMU_Options& options)
+Emulator& Emulator::operator=(Emulator&& other)
 {
-    m_options = options;
+    // Member-wise assignment would release m_arena first, while the current components still live in it
+    m_pcm.reset();
+    m_lcd.reset();
+    m_timer.reset();
+    m_sm.reset();
+    m_mcu.reset();
+
+    m_arena     = std::move(other.m_arena);
+    m_mcu       = std::move(other.m_mcu);
+    m_sm        = std::move(other.m_sm);
+    m_timer     = std::move(other.m_timer);
+    m_lcd       = std::move(other.m_lcd);
+    m_pcm       = std::move(other.m_pcm);
+    m_options   = std::move(other.m_options);
+    m_jv880_ram = std::move(other.m_jv880_ram);
+    m_step      = other.m_step;
 
-    try
+    for (size_t i = 0; i < ROMLOCATION_COUNT; ++i)
     {
-        m_mcu   = std::make_unique<mcu_t>();
-        m_sm    = std::make_unique<submcu_t>();
-        m_timer = std::make_unique<mcu_timer_t>();
-        m_lcd   = std::make_unique<lcd_t>();
-        m_pcm   = std::make_unique<pcm_t>();
+        m_roms[i] = std::move(other.m_roms[i]);
     }
-    catch (const std::bad_alloc&)
+
+    return *this;
+}
+
+bool Emulator::Init(const EMU_Options& options)
+{
+    m_options = options;
+
+    // All components share one allocation instead of being spread across the heap. The timer and sub-MCU are small
+    // and come first, so together with the head of mcu_t (see its layout) the state MCU_Step touches on every step
+    // fits in a single page. The PCM and LCD, which are only updated on events, follow the MCU's large tables.
+    size_t arena_size = 0;
+    const size_t timer_offset = EMU_ArenaSlot<mcu_timer_t>(arena_size);
+    const size_t sm_offset    = EMU_ArenaSlot<submcu_t>(arena_size);
+    const size_t mcu_offset   = EMU_ArenaSlot<mcu_t>(arena_size);
+    const size_t pcm_offset   = EMU_ArenaSlot<pcm_t>(arena_size);
+    const size_t lcd_offset   = EMU_ArenaSlot<lcd_t>(arena_size);
+
+    std::unique_ptr<void, ArenaFree> arena(AllocatePages(arena_size, false), ArenaFree{arena_size});
+    if (!arena)
     {
         m_mcu.reset();
         m_sm.reset();
         m_timer.reset();
         m_lcd.reset();
         m_pcm.reset();
+        m_arena.reset();
         return false;
     }
 
+    uint8_t* base = (uint8_t*)arena.get();
+    m_mcu.reset(new (base + mcu_offset) mcu_t());
+    m_sm.reset(new (base + sm_offset) submcu_t());
+    m_timer.reset(new (base + timer_offset) mcu_timer_t());
+    m_lcd.reset(new (base + lcd_offset) lcd_t());
+    m_pcm.reset(new (base + pcm_offset) pcm_t());
+    m_arena = std::move(arena);
+
     MCU_Init(*m_mcu, *m_sm, *m_pcm, *m_timer, *m_lcd);
     SM_Init(*m_sm, *m_mcu);
     PCM_Init(*m_pcm, *m_mcu);
@@ -77,6 +137,11 @@ bool Emulator::Init(const EMU_Options& options)
     LCD_Init(*m_lcd, *m_mcu);
     m_lcd->backend = options.lcd_backend;
 
+    for (size_t i = 0; i < ROMLOCATION_COUNT; ++i)
+    {
+        MapRom((RomLocation)i, GetEmptyRom());
+    }
+
     return true;
 }
 
@@ -102,6 +167,12 @@ void Emulator::SetSampleCallback(mcu_sample_callback callback, void* userdata)
     m_mcu->sample_callback = callback;
 }
 
+void Emulator::SetSampleSink(std::span<AudioFrame<int32_t>> sink)
+{
+    m_mcu->sample_sink       = sink;
+    m_mcu->sample_sink_count = 0;
+}
+
 bool Emulator::LoadRoms(Romset romset, const AllRomsetInfo& all_info, RomLocationSet* loaded)
 {
     if (loaded)
@@ -110,6 +181,21 @@ bool Emulator::LoadRoms(Romset romset, const AllRomsetInfo& all_info, RomLocatio
     }
 
     MCU_SetRomset(GetMCU(), romset);
+    m_step = MCU_GetStepFunction(m_mcu->family);
+
+    if (m_mcu->is_jv880 && !m_jv880_ram)
+    {
+        try
+        {
+            m_jv880_ram = std::make_unique<uint8_t[]>(NVRAM_SIZE + CARDRAM_SIZE);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+        m_mcu->nvram   = m_jv880_ram.get();
+        m_mcu->cardram = m_jv880_ram.get() + NVRAM_SIZE;
+    }
 
     const RomsetInfo& info = all_info.romsets[(size_t)romset];
 
@@ -117,14 +203,20 @@ bool Emulator::LoadRoms(Romset romset, const AllRomsetInfo& all_info, RomLocatio
     {
         const RomLocation location = (RomLocation)i;
 
-        // rom_data should be populated at this point
-        // if it isn't, then there isn't a rom for this location
-        if (info.rom_data[i].empty())
+        // rom_data or rom_images should be populated at this point
+        // if neither is, then there isn't a rom for this location
+        if (info.rom_images[i])
+        {
+            if (!LoadRom(location, info.rom_images[i]))
+            {
+                return false;
+            }
+        }
+        else if (info.rom_data[i].empty())
         {
             continue;
         }
-
-        if (!LoadRom(location, info.rom_data[i]))
+        else if (!LoadRom(location, AcquireRomImage(location, info.rom_data[i], m_options.huge_pages)))
         {
             return false;
         }
@@ -142,6 +234,9 @@ bool Emulator::LoadRoms(Romset romset, const AllRomsetInfo& all_info, RomLocatio
 
     MCU_PatchROM(*m_mcu);
 
+    // rom2_mask is only known after the roms are loaded
+    MCU_UpdatePageTable(*m_mcu);
+
     return true;
 }
 
@@ -179,7 +274,58 @@ void Emulator::PostSystemReset(EMU_SystemReset reset)
 
 void Emulator::Step()
 {
-    MCU_Step(*m_mcu);
+    m_step(*m_mcu);
+}
+
+void Emulator::SaveState(std::vector<uint8_t>& out)
+{
+    STATE_Save(out, *m_mcu, *m_sm, *m_timer, *m_pcm, *m_lcd);
+}
+
+bool Emulator::LoadState(std::span<const uint8_t> data)
+{
+    return STATE_Load(data, *m_mcu, *m_sm, *m_timer, *m_pcm, *m_lcd);
+}
+
+EMU_MemoryUsage Emulator::GetMemoryUsage() const
+{
+    EMU_MemoryUsage usage;
+
+    if (!m_mcu)
+    {
+        return usage;
+    }
+
+    usage.state = m_arena.get_deleter().size;
+
+    if (m_lcd->buffer)
+    {
+        usage.lcd_buffer = sizeof(m_lcd->buffer[0]) * lcd_height_max;
+    }
+
+    if (m_jv880_ram)
+    {
+        usage.jv880_ram = NVRAM_SIZE + CARDRAM_SIZE;
+    }
+
+    for (const auto& image : m_roms)
+    {
+        if (!image)
+        {
+            continue;
+        }
+
+        if (image->mapped)
+        {
+            usage.roms_mapped += image->size;
+        }
+        else
+        {
+            usage.roms_heap += image->size;
+        }
+    }
+
+    return usage;
 }
 
 void Emulator::SaveNVRAM()
@@ -190,7 +336,7 @@ void Emulator::SaveNVRAM()
         return;
     }
 
-    if (!m_options.nvram_filename.empty() && m_mcu->is_jv880)
+    if (!m_options.nvram_filename.empty() && m_mcu->is_jv880 && m_mcu->nvram)
     {
         std::ofstream file(m_options.nvram_filename, std::ios::binary);
         file.write((const char*)m_mcu->nvram, NVRAM_SIZE);
@@ -206,55 +352,60 @@ void Emulator::LoadNVRAM()
     }
 }
 
-std::span<uint8_t> Emulator::MapBuffer(RomLocation location)
+void Emulator::MapRom(RomLocation location, const uint8_t* data)
 {
     switch (location)
     {
     case RomLocation::ROM1:
-        return GetMCU().rom1;
+        GetMCU().rom1 = data;
+        return;
     case RomLocation::ROM2:
-        return GetMCU().rom2;
+        GetMCU().rom2 = data;
+        return;
     case RomLocation::WAVEROM1:
-        return GetPCM().waverom1;
+        GetPCM().waverom1 = data;
+        return;
     case RomLocation::WAVEROM2:
-        return GetPCM().waverom2;
+        GetPCM().waverom2 = data;
+        return;
     case RomLocation::WAVEROM3:
-        return GetPCM().waverom3;
+        GetPCM().waverom3 = data;
+        return;
     case RomLocation::WAVEROM_CARD:
-        return GetPCM().waverom_card;
+        GetPCM().waverom_card = data;
+        return;
     case RomLocation::WAVEROM_EXP:
-        return GetPCM().waverom_exp;
+        GetPCM().waverom_exp = data;
+        return;
     case RomLocation::SMROM:
-        return m_sm->rom;
+        m_sm->rom = data;
+        return;
     }
-    //fprintf(stderr, "FATAL: MapBuffer called with invalid location %d\n", (int)location);
+    //fprintf(stderr, "FATAL: MapRom called with invalid location %d\n", (int)location);
     std::abort();
 }
 
-bool Emulator::LoadRom(RomLocation location, std::span<const uint8_t> source)
+bool Emulator::LoadRom(RomLocation location, std::shared_ptr<const RomImage> image)
 {
-    auto buffer = MapBuffer(location);
-
-    if (buffer.size() < source.size())
+    if (!image || image->location != location)
     {
-        //fprintf(stderr,
-        //        "FATAL: rom for %s is too large; max size is %d bytes\n",
-        //        ToCString(location),
-        //        (int)buffer.size());
+        //fprintf(stderr, "FATAL: could not load rom for %s; max size is %d bytes\n", ToCString(location),
+        //        (int)GetRomCapacity(location));
         return false;
     }
 
     if (location == RomLocation::ROM2)
     {
-        if (!std::has_single_bit(source.size()))
+        if (!std::has_single_bit(image->size))
         {
             //fprintf(stderr, "FATAL: %s requires a power-of-2 size\n", ToCString(location));
             return false;
         }
-        GetMCU().rom2_mask = (int)source.size() - 1;
+        GetMCU().rom2_mask = (int)image->size - 1;
     }
 
-    std::copy(source.begin(), source.end(), buffer.begin());
+    MapRom(location, image->data);
+    m_roms[(size_t)location] = std::move(image);
 
     return true;
 }
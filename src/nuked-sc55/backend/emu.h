@@ -40,10 +40,12 @@
 #include "pcm.h"
 #include "rom.h"
 #include "rom_io.h"
+#include "rom_store.h"
 #include "submcu.h"
 #include <filesystem>
 #include <memory>
 #include <span>
+#include <vector>
 
 struct EMU_Options
 {
@@ -53,8 +55,37 @@ struct EMU_Options
 
     // If not empty, nvram will be saved to and loaded from here. JV-880 only.
     std::filesystem::path nvram_filename;
+
+    // Back waveroms copied by LoadRoms with huge pages where the OS allows it (see AllocatePages). Fewer TLB misses
+    // when PCM voices read all over the waveroms, but each image is rounded up to whole 2 MB pages. Roms passed in
+    // `rom_images` are used as is.
+    bool huge_pages = false;
 };
 
+// Memory held by one Emulator instance, in bytes.
+struct EMU_MemoryUsage
+{
+    // Emulator components and their RAMs.
+    size_t state = 0;
+
+    // LCD framebuffer. Only allocated once the LCD is started with a backend.
+    size_t lcd_buffer = 0;
+
+    // JV-880 nvram and cardram. Only allocated for the JV-880.
+    size_t jv880_ram = 0;
+
+    // Roms copied to the heap. These may be shared with other instances that loaded the same roms.
+    size_t roms_heap = 0;
+
+    // Roms mapped from files. Their pages are backed by the files, so the OS can drop and reload them as needed.
+    size_t roms_mapped = 0;
+
+    size_t Total() const { return state + lcd_buffer + jv880_ram + roms_heap + roms_mapped; }
+};
+
+// The most frames a single call to Emulator::Step can produce (two when the PCM oversamples)
+static const size_t EMU_MAX_FRAMES_PER_STEP = 2;
+
 enum class EMU_SystemReset {
     NONE,
     GS_RESET,
@@ -67,7 +98,7 @@ public:
 
     virtual ~Emulator();
 
-    Emulator& operator=(Emulator&&) = default;
+    Emulator& operator=(Emulator&& other);
     Emulator(Emulator&&)            = default;
 
     Emulator(const Emulator&)            = delete;
@@ -85,11 +116,20 @@ public:
 
     void SetSampleCallback(mcu_sample_callback callback, void* userdata);
 
-    // Loads roms from buffers referenced by `all_info`. If the slot for a rom in `all_info` has a non-empty `rom_data`,
-    // it will be loaded even if the romset doesn't require it.
+    // Makes the emulator store frames in `sink` instead of passing them to the sample callback, which saves a call per
+    // frame and lets the caller convert whole blocks at once. Frames are stored from the start of `sink` on every call;
+    // GetSampleSinkCount returns how many have been stored since. Frames that don't fit are dropped, so stop stepping
+    // while there is still room for EMU_MAX_FRAMES_PER_STEP more. An empty `sink` restores the sample callback.
+    void SetSampleSink(std::span<AudioFrame<int32_t>> sink);
+
+    size_t GetSampleSinkCount() const { return m_mcu->sample_sink_count; }
+
+    // Loads roms from buffers referenced by `all_info`. If the slot for a rom in `all_info` has a non-empty `rom_data`
+    // or `rom_images`, it will be loaded even if the romset doesn't require it.
     //
-    // It is unspecified whether or not the emulator will copy `rom_data`. `all_info` should outlive the emulator
-    // instance.
+    // `rom_images` are used without copying and kept alive by the emulator. `rom_data` is copied into images shared
+    // with other instances that load the same roms (see AcquireRomImage). `all_info` can be purged or destroyed as soon
+    // as this returns.
     //
     // For roms that were successfully loaded, this function will set their corresponding index in `loaded` to true if
     // `loaded` is non-null.
@@ -103,8 +143,21 @@ public:
 
     void PostSystemReset(EMU_SystemReset reset);
 
+    // True while posted MIDI bytes are still waiting for the firmware to read them.
+    bool HasPendingMIDI() const { return m_mcu->uart_write_ptr != m_mcu->uart_read_ptr; }
+
     void Step();
 
+    // Serializes the emulator's mutable state into `out`. See STATE_Save for what is included.
+    void SaveState(std::vector<uint8_t>& out);
+
+    // Restores a state produced by `SaveState` with the same romset loaded. Returns false and leaves the emulator
+    // untouched if `data` cannot be loaded.
+    bool LoadState(std::span<const uint8_t> data);
+
+    // Reports the memory this instance holds. Call after LoadRoms, and after StartLCD if the LCD is used.
+    EMU_MemoryUsage GetMemoryUsage() const;
+
     mcu_t& GetMCU() { return *m_mcu; }
     pcm_t& GetPCM() { return *m_pcm; }
     lcd_t& GetLCD() { return *m_lcd; }
@@ -113,15 +166,47 @@ private:
     void SaveNVRAM();
     void LoadNVRAM();
 
-    std::span<uint8_t> MapBuffer(RomLocation location);
+    // Points the component that reads `location` at `data`.
+    void MapRom(RomLocation location, const uint8_t* data);
 
-    bool LoadRom(RomLocation location, std::span<const uint8_t> source);
+    bool LoadRom(RomLocation location, std::shared_ptr<const RomImage> image);
 
 private:
-    std::unique_ptr<mcu_t>       m_mcu;
-    std::unique_ptr<submcu_t>    m_sm;
-    std::unique_ptr<mcu_timer_t> m_timer;
-    std::unique_ptr<lcd_t>       m_lcd;
-    std::unique_ptr<pcm_t>       m_pcm;
+    // Destroys a component in place. Its memory belongs to m_arena.
+    struct ArenaDestroy
+    {
+        template <typename T>
+        void operator()(T* ptr) const
+        {
+            ptr->~T();
+        }
+    };
+
+    struct ArenaFree
+    {
+        size_t size;
+        void   operator()(void* ptr) const;
+    };
+
+    template <typename T>
+    using ArenaPtr = std::unique_ptr<T, ArenaDestroy>;
+
+private:
+    // Holds the components below. Declared first so that it is released after them; see Init.
+    std::unique_ptr<void, ArenaFree> m_arena;
+    ArenaPtr<mcu_t>              m_mcu;
+    ArenaPtr<submcu_t>           m_sm;
+    ArenaPtr<mcu_timer_t>        m_timer;
+    ArenaPtr<lcd_t>              m_lcd;
+    ArenaPtr<pcm_t>              m_pcm;
     EMU_Options                  m_options;
+
+    // Backs m_mcu->nvram and m_mcu->cardram once a JV-880 romset is loaded
+    std::unique_ptr<uint8_t[]>   m_jv880_ram;
+
+    // Keeps the images referenced by the rom pointers in m_mcu, m_sm and m_pcm alive. Indexed by RomLocation.
+    std::shared_ptr<const RomImage> m_roms[ROMLOCATION_COUNT];
+
+    // MCU_Step instantiation for the loaded romset, picked in LoadRoms
+    mcu_step_func                m_step = MCU_Step<RomsetFamily::MK2>;
 };
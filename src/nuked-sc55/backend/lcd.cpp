@@ -175,6 +175,18 @@ bool LCD_Start(lcd_t& lcd)
 
     if (lcd.backend)
     {
+        if (!lcd.buffer)
+        {
+            try
+            {
+                lcd.buffer = std::make_unique<uint32_t[][lcd_width_max]>(lcd_height_max);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+        }
+
         if (!lcd.backend->Start(lcd))
         {
             success = false;
@@ -330,7 +342,7 @@ void LCD_FontRenderLR(lcd_t& lcd, uint8_t* LCD_CG, uint8_t ch)
 
 void LCD_Render(lcd_t& lcd)
 {
-    if (!lcd.backend)
+    if (!lcd.backend || !lcd.buffer)
     {
         return;
     }
@@ -358,7 +370,7 @@ void LCD_Render(lcd_t& lcd)
 
         if (!lcd.enable && !lcd.mcu->is_jv880)
         {
-            memset(lcd.buffer, 0, sizeof(lcd.buffer));
+            memset(lcd.buffer.get(), 0, sizeof(lcd.buffer[0]) * lcd_height_max);
         }
         else
         {
@@ -36,6 +36,7 @@
 
 #include <atomic>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 
 struct mcu_t;
@@ -79,7 +80,8 @@ struct lcd_t {
     // updated by MCU via LCD_Enable
     std::atomic<uint8_t> enable = 0;
 
-    uint32_t buffer[lcd_height_max][lcd_width_max]{};
+    // lcd_height_max rows of lcd_width_max pixels. Only allocated by LCD_Start when there is a backend to display it.
+    std::unique_ptr<uint32_t[][lcd_width_max]> buffer;
 
     std::mutex mutex;
 
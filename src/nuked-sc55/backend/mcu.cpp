@@ -38,6 +38,8 @@
 #include "mcu_timer.h"
 #include "pcm.h"
 #include "submcu.h"
+#include <algorithm>
+#include <type_traits>
 
 void MCU_ErrorTrap(mcu_t& mcu)
 {
@@ -193,6 +195,7 @@ void MCU_DeviceWrite(mcu_t& mcu, uint32_t address, uint8_t data)
     case DEV_RAME: // RAME
         break;
     case DEV_P1CR: // P1CR
+        mcu.interrupt_check = 1;
         break;
     case DEV_DTEA:
         break;
@@ -207,12 +210,10 @@ void MCU_DeviceWrite(mcu_t& mcu, uint32_t address, uint8_t data)
     case DEV_BRR:
         break;
     case DEV_IPRA:
-        break;
     case DEV_IPRB:
-        break;
     case DEV_IPRC:
-        break;
     case DEV_IPRD:
+        mcu.interrupt_check = 1;
         break;
     case DEV_PWM1_DTR:
         break;
@@ -279,7 +280,13 @@ void MCU_DeviceWrite(mcu_t& mcu, uint32_t address, uint8_t data)
         address += 0;
         break;
     }
+    // Only the RAM enable bit changes the page table; rebuilding it also flushes the decode cache
+    const bool ram_enable_changed = address == DEV_RAME && ((mcu.dev_register[address] ^ data) & 0x80) != 0;
+
     mcu.dev_register[address] = data;
+
+    if (ram_enable_changed)
+        MCU_UpdatePageTable(mcu);
 }
 
 uint8_t MCU_DeviceRead(mcu_t& mcu, uint32_t address)
@@ -370,6 +377,8 @@ void MCU_DeviceReset(mcu_t& mcu)
     // mcu.dev_register[0x7c] = 0x87;
     mcu.dev_register[DEV_RAME] = 0x80;
     mcu.dev_register[DEV_SSR] = 0x80;
+
+    MCU_UpdatePageTable(mcu);
 }
 
 void MCU_UpdateAnalog(mcu_t& mcu, uint64_t cycles)
@@ -405,7 +414,7 @@ void MCU_UpdateAnalog(mcu_t& mcu, uint64_t cycles)
         mcu.analog_end_time = 0;
 }
 
-uint8_t MCU_Read(mcu_t& mcu, uint32_t address)
+uint8_t MCU_ReadUnmapped(mcu_t& mcu, uint32_t address)
 {
     uint32_t address_rom = address & 0x3ffff;
     if (address & 0x80000 && !mcu.is_jv880)
@@ -607,8 +616,11 @@ uint32_t MCU_Read32(mcu_t& mcu, uint32_t address)
     return (b0 << 24) + (b1 << 16) + (b2 << 8) + b3;
 }
 
-void MCU_Write(mcu_t& mcu, uint32_t address, uint8_t value)
+void MCU_WriteUnmapped(mcu_t& mcu, uint32_t address, uint8_t value)
 {
+    // any device write may move a peripheral deadline closer
+    mcu.next_event = 0;
+
     uint8_t page = (address >> 16) & 0xf;
     address &= 0xffff;
     if (page == 0)
@@ -750,11 +762,135 @@ void MCU_Write16(mcu_t& mcu, uint32_t address, uint16_t value)
     MCU_Write(mcu, address + 1, value & 0xff);
 }
 
+// Maps `size` bytes at `address` to `mem[(index + offset) & mask]`. Memory that isn't allocated yet (the JV-880 NVRAM
+// and card RAM before LoadRoms, or roms that aren't loaded) stays unmapped and goes through the slow path.
+template <typename T>
+static void MCU_MapPages(T** table, uint32_t address, uint32_t size, std::type_identity_t<T>* mem, uint32_t index,
+                         uint32_t mask)
+{
+    if (!mem)
+        return;
+    for (uint32_t offset = 0; offset < size; offset += MCU_PAGE_SIZE)
+        table[(address + offset) >> MCU_PAGE_SHIFT] = mem + ((index + offset) & mask);
+}
+
+// Mirrors the plain memory cases of MCU_ReadUnmapped/MCU_WriteUnmapped. Anything with side effects or mixed
+// contents within a page stays unmapped.
+void MCU_UpdatePageTable(mcu_t& mcu)
+{
+    for (int i = 0; i < MCU_PAGE_COUNT; i++)
+    {
+        mcu.page_read[i] = nullptr;
+        mcu.page_write[i] = nullptr;
+    }
+
+    for (int i = 0; i < MCU_DECODE_CACHE_SIZE; i++)
+        mcu.decode_cache[i].address = UINT32_MAX;
+
+    // page 0
+    MCU_MapPages(mcu.page_read, 0x0000, 0x8000, mcu.rom1, 0, 0x7fff);
+    MCU_MapPages(mcu.page_read, 0x8000, 0x6000, mcu.sram, 0, 0x7fff);
+    MCU_MapPages(mcu.page_write, 0x8000, 0x6000, mcu.sram, 0, 0x7fff);
+    if ((mcu.dev_register[DEV_RAME] & 0x80) != 0)
+    {
+        // 0xfb80-0xff7f, only the fully covered pages
+        MCU_MapPages(mcu.page_read, 0xfc00, 0x300, mcu.ram, 0x80, 0x3ff);
+        MCU_MapPages(mcu.page_write, 0xfc00, 0x300, mcu.ram, 0x80, 0x3ff);
+    }
+
+    // pages 1-15
+    for (uint32_t page = 1; page < 16; page++)
+    {
+        uint32_t address = page << 16;
+        uint32_t address_rom = address & 0x3ffff;
+        if (address & 0x80000 && !mcu.is_jv880)
+            address_rom |= 0x40000;
+
+        switch (page)
+        {
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+            MCU_MapPages(mcu.page_read, address, 0x10000, mcu.rom2, address_rom, mcu.rom2_mask);
+            break;
+        case 8:
+        case 9:
+            if (!mcu.is_jv880)
+                MCU_MapPages(mcu.page_read, address, 0x10000, mcu.rom2, address_rom, mcu.rom2_mask);
+            break;
+        case 14:
+        case 15:
+            if (!mcu.is_jv880)
+                MCU_MapPages(mcu.page_read, address, 0x10000, mcu.rom2, address_rom, mcu.rom2_mask);
+            else
+                MCU_MapPages(mcu.page_read, address, 0x10000, mcu.cardram, 0, 0x7fff);
+            if (page == 14 && mcu.is_jv880)
+                MCU_MapPages(mcu.page_write, address, 0x10000, mcu.cardram, 0, 0x7fff);
+            break;
+        case 10:
+        case 11:
+            if (!mcu.is_mk1)
+                MCU_MapPages(mcu.page_read, address, 0x10000, mcu.sram, 0, 0x7fff);
+            if (page == 10 && !mcu.is_mk1)
+                MCU_MapPages(mcu.page_write, address, 0x10000, mcu.sram, 0, 0x7fff);
+            break;
+        case 12:
+        case 13:
+            if (mcu.is_jv880)
+                MCU_MapPages(mcu.page_read, address, 0x10000, mcu.nvram, 0, 0x7fff);
+            if (page == 12 && mcu.is_jv880)
+                MCU_MapPages(mcu.page_write, address, 0x10000, mcu.nvram, 0, 0x7fff);
+            break;
+        case 5:
+            if (mcu.is_mk1)
+            {
+                MCU_MapPages(mcu.page_read, address, 0x10000, mcu.sram, 0, 0x7fff);
+                MCU_MapPages(mcu.page_write, address, 0x10000, mcu.sram, 0, 0x7fff);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static bool MCU_IsRomCode(mcu_t& mcu, uint8_t cp, uint16_t pc, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++)
+    {
+        uint32_t address = MCU_GetAddress(cp, (uint16_t)(pc + i));
+        const uint8_t* page = mcu.page_read[(address >> MCU_PAGE_SHIFT) & (MCU_PAGE_COUNT - 1)];
+        bool rom1 = page >= mcu.rom1 && page < mcu.rom1 + ROM1_SIZE;
+        bool rom2 = page >= mcu.rom2 && page < mcu.rom2 + ROM2_SIZE;
+        if (!page || (!rom1 && !rom2))
+            return false;
+    }
+    return true;
+}
+
 void MCU_ReadInstruction(mcu_t& mcu)
 {
-    uint8_t operand = MCU_ReadCodeAdvance(mcu);
+    uint32_t address = MCU_GetAddress(mcu.cp, mcu.pc);
+    mcu_decoded_t& cached = mcu.decode_cache[address & (MCU_DECODE_CACHE_SIZE - 1)];
 
-    MCU_Operand_Table[operand](mcu, operand);
+    if (cached.address == address)
+    {
+        mcu.pc += cached.length;
+        MCU_Operand_Execute(mcu, cached);
+    }
+    else
+    {
+        mcu_decoded_t dec;
+        uint16_t pc = mcu.pc;
+        MCU_Operand_Decode(mcu, dec);
+        if (MCU_IsRomCode(mcu, mcu.cp, pc, dec.length))
+        {
+            cached = dec;
+            cached.address = address;
+        }
+        MCU_Operand_Execute(mcu, dec);
+    }
 
     if (mcu.sr & STATUS_T)
     {
@@ -795,6 +931,8 @@ void MCU_Reset(mcu_t& mcu)
     mcu.pc = 0;
 
     mcu.sr = 0x700;
+    mcu.flags_op = FLAGS_NONE;
+    mcu.interrupt_check = 1;
 
     mcu.cp = 0;
     mcu.dp = 0;
@@ -807,6 +945,7 @@ void MCU_Reset(mcu_t& mcu)
     mcu.pc = reset_address & 0xffff;
 
     mcu.exception_pending = -1;
+    mcu.next_event = 0;
 
     MCU_DeviceReset(mcu);
 
@@ -820,6 +959,7 @@ void MCU_PostUART(mcu_t& mcu, uint8_t data)
 {
     mcu.uart_buffer[mcu.uart_write_ptr] = data;
     mcu.uart_write_ptr = (mcu.uart_write_ptr + 1) % uart_buffer_size;
+    mcu.next_event = 0;
 }
 
 void MCU_UpdateUART_RX(mcu_t& mcu)
@@ -859,36 +999,70 @@ void MCU_UpdateUART_TX(mcu_t& mcu)
     // fprintf(stderr, "tx:%x\n", mcu.dev_register[DEV_TDR]);
 }
 
-void MCU_Step(mcu_t& mcu)
+// Returns the earliest cycle count at which one of the deadline-driven updates in MCU_Step can change state.
+// Anything that moves a deadline closer (device writes, incoming UART bytes, reset) clears mcu.next_event.
+template <RomsetFamily family>
+static uint64_t MCU_NextEvent(mcu_t& mcu)
 {
-    if (!mcu.ex_ignore)
-        MCU_Interrupt_Handle(mcu);
-    else
-        mcu.ex_ignore = 0;
+    uint64_t next = std::min(PCM_NextEvent(*mcu.pcm), TIMER_NextEvent<family>(*mcu.timer));
 
-    if (!mcu.sleep)
-        MCU_ReadInstruction(mcu);
+    if constexpr (family != RomsetFamily::MK2)
+    {
+        if ((mcu.dev_register[DEV_SCR] & 16) != 0 && mcu.uart_write_ptr != mcu.uart_read_ptr
+            && (mcu.dev_register[DEV_SSR] & 0x40) == 0)
+            next = std::min(next, mcu.uart_rx_delay);
+        if ((mcu.dev_register[DEV_SCR] & 32) != 0 && (mcu.dev_register[DEV_SSR] & 0x80) == 0)
+            next = std::min(next, mcu.uart_tx_delay);
+    }
+
+    if (mcu.dev_register[DEV_ADCSR] & 0x20)
+        next = std::min(next, mcu.analog_end_time == 0 ? 0 : mcu.analog_end_time + 1);
+    else if (mcu.analog_end_time != 0)
+        next = 0;
+
+    if constexpr (family == RomsetFamily::MK1)
+    {
+        if (mcu.ga_lcd_counter)
+            next = 0;
+    }
 
+    return next;
+}
+
+// Advances the clock by one instruction slot and runs the peripherals. Returns true if the deadline-driven
+// updates ran.
+template <RomsetFamily family>
+static bool MCU_UpdatePeripherals(mcu_t& mcu)
+{
     mcu.cycles += 12; // FIXME: assume 12 cycles per instruction
 
     // if (mcu.cycles % 24000000 == 0)
     //     fprintf(stderr, "seconds: %i\n", (int)(mcu.cycles / 24000000));
 
-    PCM_Update(*mcu.pcm, mcu.cycles);
+    // PCM, timer, UART, ADC and GA LCD updates only run once the earliest of their deadlines is reached. The
+    // sub-MCU still runs every instruction.
+    const bool events = mcu.cycles >= mcu.next_event;
 
-    TIMER_Clock(*mcu.timer, mcu.cycles);
+    if (events)
+    {
+        PCM_Update<family>(*mcu.pcm, mcu.cycles);
+        TIMER_Clock<family>(*mcu.timer, mcu.cycles);
+    }
 
-    if (!mcu.is_mk1 && !mcu.is_jv880 && !mcu.is_scb55)
+    if constexpr (family == RomsetFamily::MK2)
         SM_Update(*mcu.sm, mcu.cycles);
-    else
+    else if (events)
     {
         MCU_UpdateUART_RX(mcu);
         MCU_UpdateUART_TX(mcu);
     }
 
+    if (!events)
+        return false;
+
     MCU_UpdateAnalog(mcu, mcu.cycles);
 
-    if (mcu.is_mk1)
+    if constexpr (family == RomsetFamily::MK1)
     {
         if (mcu.ga_lcd_counter)
         {
@@ -900,6 +1074,59 @@ void MCU_Step(mcu_t& mcu)
             }
         }
     }
+
+    mcu.next_event = mcu.run_every_update ? 0 : MCU_NextEvent<family>(mcu);
+    return true;
+}
+
+template <RomsetFamily family>
+void MCU_Step(mcu_t& mcu)
+{
+    const bool check_interrupts = !mcu.ex_ignore;
+
+    if (!check_interrupts)
+        mcu.ex_ignore = 0;
+    else if (mcu.interrupt_check)
+        MCU_Interrupt_Handle(mcu);
+
+    if (!mcu.sleep)
+    {
+        MCU_ReadInstruction(mcu);
+        MCU_UpdatePeripherals<family>(mcu);
+        return;
+    }
+
+    // Asleep, only an interrupt request can wake the MCU, and there is nothing it could take right now. Keep
+    // clocking the peripherals until a request changes or a deadline-driven device has run, which bounds one call
+    // to about one PCM slot.
+    bool events = MCU_UpdatePeripherals<family>(mcu);
+    while (check_interrupts && !events && !mcu.interrupt_check)
+        events = MCU_UpdatePeripherals<family>(mcu);
+}
+
+template void MCU_Step<RomsetFamily::MK2>(mcu_t& mcu);
+template void MCU_Step<RomsetFamily::MK1>(mcu_t& mcu);
+template void MCU_Step<RomsetFamily::JV880>(mcu_t& mcu);
+template void MCU_Step<RomsetFamily::SCB55>(mcu_t& mcu);
+
+mcu_step_func MCU_GetStepFunction(RomsetFamily family)
+{
+    switch (family)
+    {
+    case RomsetFamily::MK1:
+        return MCU_Step<RomsetFamily::MK1>;
+    case RomsetFamily::JV880:
+        return MCU_Step<RomsetFamily::JV880>;
+    case RomsetFamily::SCB55:
+        return MCU_Step<RomsetFamily::SCB55>;
+    default:
+        return MCU_Step<RomsetFamily::MK2>;
+    }
+}
+
+void MCU_Step(mcu_t& mcu)
+{
+    MCU_GetStepFunction(mcu.family)(mcu);
 }
 
 void MCU_PatchROM(mcu_t& mcu)
@@ -943,11 +1170,6 @@ void MCU_WriteP1(mcu_t& mcu, uint8_t data)
     mcu.p1_data = data;
 }
 
-void MCU_PostSample(mcu_t& mcu, const AudioFrame<int32_t>& frame)
-{
-    mcu.sample_callback(mcu.callback_userdata, frame);
-}
-
 void MCU_GA_SetGAInt(mcu_t& mcu, int line, int value)
 {
     // guesswork
@@ -971,6 +1193,7 @@ void MCU_EncoderTrigger(mcu_t& mcu, int dir)
 void MCU_SetRomset(mcu_t& mcu, Romset romset)
 {
     mcu.romset   = romset;
+    mcu.family   = GetRomsetFamily(romset);
     mcu.is_mk1   = false;
     mcu.is_cm300 = false;
     mcu.is_st    = false;
@@ -1007,4 +1230,6 @@ void MCU_SetRomset(mcu_t& mcu, Romset romset)
         mcu.is_scb55 = true;
         break;
     }
+
+    MCU_UpdatePageTable(mcu);
 }
@@ -39,6 +39,7 @@
 #include "rom.h"
 #include <atomic>
 #include <cstdint>
+#include <span>
 
 struct submcu_t;
 struct pcm_t;
@@ -120,6 +121,14 @@ enum {
     STATUS_INT_MASK = 0x700
 };
 
+// Last flag-setting operation whose N/Z/V/C have not been folded into sr yet.
+enum {
+    FLAGS_NONE = 0, // sr is up to date
+    FLAGS_LOGIC, // N/Z from flags_t1, V cleared, C unchanged
+    FLAGS_ADD, // flags_t1 + flags_t2 + flags_carry
+    FLAGS_SUB, // flags_t1 - flags_t2 - flags_carry
+};
+
 enum {
     VECTOR_RESET = 0,
     VECTOR_RESERVED1, // UNUSED
@@ -190,50 +199,82 @@ static const int ROMSM_SIZE = 0x1000;
 
 static const uint32_t uart_buffer_size = 8192;
 
+// The 1 MB address space is split into 256-byte pages. Pages backed by plain memory resolve to a host pointer, the
+// rest (PCM, sub-MCU, device registers, gate array) are left null and go through the slow path in mcu.cpp.
+static const int MCU_PAGE_SHIFT = 8;
+static const int MCU_PAGE_SIZE = 1 << MCU_PAGE_SHIFT;
+static const int MCU_PAGE_COUNT = 0x100000 >> MCU_PAGE_SHIFT;
+
+// Decoded instructions are cached by (cp << 16) | pc in a direct-mapped table. Only instructions that lie entirely
+// in rom1/rom2 are entered, so code running from SRAM or on-chip RAM is always decoded from memory.
+static const int MCU_DECODE_CACHE_SIZE = 0x2000;
+
+struct mcu_decoded_t {
+    uint32_t address = UINT32_MAX;
+    uint16_t value = 0; // displacement, absolute address or immediate data
+    uint8_t operand = 0;
+    uint8_t length = 0;
+    uint8_t general = 0;
+    uint8_t type = 0;
+    uint8_t increase = 0;
+    uint8_t extended = 0;
+    uint8_t opcode = 0;
+    uint8_t opcode_reg = 0;
+};
+
 typedef void(*mcu_sample_callback)(void* userdata, const AudioFrame<int32_t>& frame);
 
 void MCU_DefaultSampleCallback(void* userdata, const AudioFrame<int32_t>& frame);
 
 struct mcu_t {
+    // Fields are ordered by how often MCU_Step touches them: registers and per-step scalars first so that they share
+    // a few cache lines, then the working RAMs, then the large page and decode tables.
     uint16_t r[8]{};
     uint16_t pc = 0;
     uint16_t sr = 0;
+    // Condition flags are evaluated lazily. Arithmetic and logic instructions only record their operands here,
+    // and MCU_SyncFlags brings sr up to date before anything reads or partially updates the flags.
+    uint8_t flags_op = FLAGS_NONE;
+    uint8_t flags_word = 0;
+    uint8_t flags_carry = 0;
+    uint16_t flags_t1 = 0;
+    uint16_t flags_t2 = 0;
     uint8_t cp = 0, dp = 0, ep = 0, tp = 0, br = 0;
     uint8_t sleep = 0;
     uint8_t ex_ignore = 0;
     int32_t exception_pending = 0;
-    uint8_t interrupt_pending[INTERRUPT_SOURCE_MAX]{};
-    uint8_t trapa_pending[16]{};
+    uint32_t interrupt_pending = 0; // one bit per INTERRUPT_SOURCE_*
+    uint16_t trapa_pending = 0; // one bit per TRAPA vector
+    // Set whenever a request, exception, sr or the priority/port control registers change; cleared by
+    // MCU_Interrupt_Handle when nothing can be taken, so the common case is a single test in MCU_Step.
+    uint8_t interrupt_check = 1;
     uint64_t cycles = 0;
+    uint64_t next_event = 0; // PCM/timer/UART/ADC/GA updates are skipped until cycles reaches this
+    // Runs the deadline-driven updates on every step instead, as if nothing could be skipped. Only meant for checking
+    // the scheduled stepping against it (see tests/mcu_schedule_test.cpp).
+    bool run_every_update = false;
 
-    uint8_t rom1[ROM1_SIZE]{};
-    uint8_t rom2[ROM2_SIZE]{};
-    uint8_t ram[RAM_SIZE]{};
-    uint8_t sram[SRAM_SIZE]{};
-    uint8_t nvram[NVRAM_SIZE]{};
-    uint8_t cardram[CARDRAM_SIZE]{};
-
-    uint8_t dev_register[0x80]{};
+    uint32_t operand_type = 0;
+    uint16_t operand_ea = 0;
+    uint8_t operand_ep = 0;
+    uint8_t operand_size = 0;
+    uint8_t operand_reg = 0;
+    uint8_t operand_status = 0;
+    uint16_t operand_data = 0;
+    uint8_t opcode_extended = 0;
 
-    uint16_t ad_val[4]{};
-    uint8_t ad_nibble = 0;
-    uint8_t sw_pos = 3;
-    uint8_t io_sd = 0;
+    // Read-only, possibly shared with other instances. Point to ROM1_SIZE/ROM2_SIZE bytes; see RomImage.
+    const uint8_t* rom1 = nullptr;
+    const uint8_t* rom2 = nullptr;
+    int rom2_mask = ROM2_SIZE - 1;
 
     submcu_t* sm = nullptr;
     pcm_t* pcm = nullptr;
     mcu_timer_t* timer = nullptr;
     lcd_t* lcd = nullptr;
 
-    uint32_t uart_write_ptr = 0;
-    uint32_t uart_read_ptr = 0;
-    uint8_t uart_buffer[uart_buffer_size]{};
-
-    uint8_t uart_rx_byte = 0;
-    uint64_t uart_rx_delay = 0;
-    uint64_t uart_tx_delay = 0;
-
     Romset romset = Romset::MK2;
+    RomsetFamily family = RomsetFamily::MK2;
 
     int is_mk1 = 0; // 0 - SC-55mkII, SC-55ST. 1 - SC-55, CM-300/SCC-1
     int is_cm300 = 0; // 0 - SC-55, 1 - CM-300/SCC-1
@@ -242,7 +283,11 @@ struct mcu_t {
     int is_scb55 = 0; // 0 - sub mcu (e.g SC-55mk2), 1 - no sub mcu (e.g SCB-55)
     int is_sc155 = 0; // 0 - SC-55(MK2), 1 - SC-155(MK2)
 
-    int rom2_mask = ROM2_SIZE - 1;
+    uint32_t uart_write_ptr = 0;
+    uint32_t uart_read_ptr = 0;
+    uint8_t uart_rx_byte = 0;
+    uint64_t uart_rx_delay = 0;
+    uint64_t uart_tx_delay = 0;
 
     int ga_int[8]{};
     int ga_int_enable = 0;
@@ -260,32 +305,73 @@ struct mcu_t {
 
     int ssr_rd = 0;
 
-    uint32_t operand_type = 0;
-    uint16_t operand_ea = 0;
-    uint8_t operand_ep = 0;
-    uint8_t operand_size = 0;
-    uint8_t operand_reg = 0;
-    uint8_t operand_status = 0;
-    uint16_t operand_data = 0;
-    uint8_t opcode_extended = 0;
+    uint16_t ad_val[4]{};
+    uint8_t ad_nibble = 0;
+    uint8_t sw_pos = 3;
+    uint8_t io_sd = 0;
 
     void* callback_userdata = nullptr;
     mcu_sample_callback sample_callback = MCU_DefaultSampleCallback;
+
+    // If not empty, frames are stored here instead of being passed to sample_callback; see Emulator::SetSampleSink.
+    std::span<AudioFrame<int32_t>> sample_sink;
+    size_t sample_sink_count = 0;
+
+    // JV880 only. Point to NVRAM_SIZE/CARDRAM_SIZE bytes owned by the Emulator; null for other romsets.
+    uint8_t* nvram = nullptr;
+    uint8_t* cardram = nullptr;
+
+    uint8_t dev_register[0x80]{};
+    uint8_t ram[RAM_SIZE]{};
+    uint8_t sram[SRAM_SIZE]{};
+    uint8_t uart_buffer[uart_buffer_size]{};
+
+    const uint8_t* page_read[MCU_PAGE_COUNT]{};
+    uint8_t* page_write[MCU_PAGE_COUNT]{};
+
+    mcu_decoded_t decode_cache[MCU_DECODE_CACHE_SIZE];
 };
 
 void MCU_Init(mcu_t& mcu, submcu_t& sm, pcm_t& pcm, mcu_timer_t& timer, lcd_t& lcd);
 void MCU_Reset(mcu_t& mcu);
 void MCU_PatchROM(mcu_t& mcu);
 void MCU_Step(mcu_t& mcu);
+// MCU_Step specialised for one romset family. The family must match mcu.family.
+template <RomsetFamily family>
+void MCU_Step(mcu_t& mcu);
+
+using mcu_step_func = void (*)(mcu_t& mcu);
+mcu_step_func MCU_GetStepFunction(RomsetFamily family);
 
 void MCU_ErrorTrap(mcu_t& mcu);
 
-uint8_t MCU_Read(mcu_t& mcu, uint32_t address);
+uint8_t MCU_ReadUnmapped(mcu_t& mcu, uint32_t address);
 uint16_t MCU_Read16(mcu_t& mcu, uint32_t address);
 uint32_t MCU_Read32(mcu_t& mcu, uint32_t address);
-void MCU_Write(mcu_t& mcu, uint32_t address, uint8_t value);
+void MCU_WriteUnmapped(mcu_t& mcu, uint32_t address, uint8_t value);
 void MCU_Write16(mcu_t& mcu, uint32_t address, uint16_t value);
 
+// Rebuilds the page tables from the current romset, rom2 size and RAME bit. Also drops the decoded instruction
+// cache, since the set of rom-backed pages may have changed.
+void MCU_UpdatePageTable(mcu_t& mcu);
+
+inline uint8_t MCU_Read(mcu_t& mcu, uint32_t address)
+{
+    const uint8_t* page = mcu.page_read[(address >> MCU_PAGE_SHIFT) & (MCU_PAGE_COUNT - 1)];
+    if (page)
+        return page[address & (MCU_PAGE_SIZE - 1)];
+    return MCU_ReadUnmapped(mcu, address);
+}
+
+inline void MCU_Write(mcu_t& mcu, uint32_t address, uint8_t value)
+{
+    uint8_t* page = mcu.page_write[(address >> MCU_PAGE_SHIFT) & (MCU_PAGE_COUNT - 1)];
+    if (page)
+        page[address & (MCU_PAGE_SIZE - 1)] = value;
+    else
+        MCU_WriteUnmapped(mcu, address, value);
+}
+
 inline uint32_t MCU_GetAddress(uint8_t page, uint16_t address) {
     return ((uint32_t)page << 16) + address;
 }
@@ -319,6 +405,14 @@ inline uint32_t MCU_GetPageForRegister(mcu_t& mcu, uint32_t reg)
     return mcu.dp;
 }
 
+void MCU_EvaluateFlags(mcu_t& mcu);
+
+inline void MCU_SyncFlags(mcu_t& mcu)
+{
+    if (mcu.flags_op != FLAGS_NONE)
+        MCU_EvaluateFlags(mcu);
+}
+
 inline void MCU_ControlRegisterWrite(mcu_t& mcu, uint32_t reg, uint32_t siz, uint32_t data)
 {
     if (siz)
@@ -327,6 +421,8 @@ inline void MCU_ControlRegisterWrite(mcu_t& mcu, uint32_t reg, uint32_t siz, uin
         {
             mcu.sr = (uint16_t)data;
             mcu.sr &= sr_mask;
+            mcu.flags_op = FLAGS_NONE;
+            mcu.interrupt_check = 1;
         }
         else if (reg == 5) // FIXME: undocumented
         {
@@ -352,6 +448,7 @@ inline void MCU_ControlRegisterWrite(mcu_t& mcu, uint32_t reg, uint32_t siz, uin
             mcu.sr &= ~0xff;
             mcu.sr |= data & 0xff;
             mcu.sr &= sr_mask;
+            mcu.flags_op = FLAGS_NONE;
         }
         else if (reg == 3)
         {
@@ -383,6 +480,7 @@ inline uint32_t MCU_ControlRegisterRead(mcu_t& mcu, uint32_t reg, uint32_t siz)
     {
         if (reg == 0)
         {
+            MCU_SyncFlags(mcu);
             ret = mcu.sr & sr_mask;
         }
         else if (reg == 5) // FIXME: undocumented
@@ -407,6 +505,7 @@ inline uint32_t MCU_ControlRegisterRead(mcu_t& mcu, uint32_t reg, uint32_t siz)
     {
         if (reg == 1)
         {
+            MCU_SyncFlags(mcu);
             ret = mcu.sr & sr_mask;
         }
         else if (reg == 3)
@@ -436,6 +535,7 @@ inline uint32_t MCU_ControlRegisterRead(mcu_t& mcu, uint32_t reg, uint32_t siz)
 
 inline void MCU_SetStatus(mcu_t& mcu, uint32_t condition, uint32_t mask)
 {
+    MCU_SyncFlags(mcu);
     if (condition)
         mcu.sr |= (uint16_t)mask;
     else
@@ -525,7 +625,17 @@ void MCU_GA_SetGAInt(mcu_t& mcu, int line, int value);
 
 void MCU_EncoderTrigger(mcu_t& mcu, int dir);
 
-void MCU_PostSample(mcu_t& mcu, const AudioFrame<int32_t>& frame);
+inline void MCU_PostSample(mcu_t& mcu, const AudioFrame<int32_t>& frame)
+{
+    if (!mcu.sample_sink.empty())
+    {
+        // frames that don't fit are dropped
+        if (mcu.sample_sink_count < mcu.sample_sink.size())
+            mcu.sample_sink[mcu.sample_sink_count++] = frame;
+        return;
+    }
+    mcu.sample_callback(mcu.callback_userdata, frame);
+}
 void MCU_PostUART(mcu_t& mcu, uint8_t data);
 
 void MCU_SetRomset(mcu_t& mcu, Romset romset);
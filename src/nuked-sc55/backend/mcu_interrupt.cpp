@@ -34,9 +34,11 @@
 
 #include "mcu_interrupt.h"
 #include "mcu.h"
+#include <bit>
 
 void MCU_Interrupt_Start(mcu_t& mcu, int32_t mask)
 {
+    MCU_SyncFlags(mcu);
     MCU_PushStack(mcu, mcu.pc);
     MCU_PushStack(mcu, mcu.cp);
     MCU_PushStack(mcu, mcu.sr);
@@ -47,11 +49,19 @@ void MCU_Interrupt_Start(mcu_t& mcu, int32_t mask)
         mcu.sr |= mask << 8;
     }
     mcu.sleep = 0;
+    mcu.interrupt_check = 1;
 }
 
 void MCU_Interrupt_SetRequest(mcu_t& mcu, uint32_t interrupt, uint32_t value)
 {
-    mcu.interrupt_pending[interrupt] = value;
+    uint32_t pending = mcu.interrupt_pending & ~(1u << interrupt);
+    if (value)
+        pending |= 1u << interrupt;
+    if (pending != mcu.interrupt_pending)
+    {
+        mcu.interrupt_pending = pending;
+        mcu.interrupt_check = 1;
+    }
 }
 
 void MCU_Interrupt_Exception(mcu_t& mcu, uint32_t exception)
@@ -63,11 +73,13 @@ void MCU_Interrupt_Exception(mcu_t& mcu, uint32_t exception)
         return;
 #endif
     mcu.exception_pending = exception;
+    mcu.interrupt_check = 1;
 }
 
 void MCU_Interrupt_TRAPA(mcu_t& mcu, uint32_t vector)
 {
-    mcu.trapa_pending[vector] = 1;
+    mcu.trapa_pending |= 1 << vector;
+    mcu.interrupt_check = 1;
 }
 
 void MCU_Interrupt_StartVector(mcu_t& mcu, uint32_t vector, int32_t mask)
@@ -78,6 +90,37 @@ void MCU_Interrupt_StartVector(mcu_t& mcu, uint32_t vector, int32_t mask)
     mcu.pc = address;
 }
 
+struct interrupt_source_t {
+    int32_t vector;
+    uint8_t ipr; // priority register, level is (ipr >> shift) & 7
+    uint8_t shift;
+    uint8_t p1cr; // P1CR bit that has to be set for IRQ0/IRQ1
+};
+
+static const interrupt_source_t MCU_Interrupt_Sources[INTERRUPT_SOURCE_MAX] = {
+    { -1, 0, 0, 0 }, // NMI, handled above
+    { VECTOR_IRQ0, DEV_IPRA, 4, 0x20 },
+    { VECTOR_IRQ1, DEV_IPRA, 0, 0x40 },
+    { -1, 0, 0, 0 }, // FRT0 ICI
+    { VECTOR_INTERNAL_INTERRUPT_94, DEV_IPRB, 4, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_98, DEV_IPRB, 4, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_9C, DEV_IPRB, 4, 0 },
+    { -1, 0, 0, 0 }, // FRT1 ICI
+    { VECTOR_INTERNAL_INTERRUPT_A4, DEV_IPRB, 0, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_A8, DEV_IPRB, 0, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_AC, DEV_IPRB, 0, 0 },
+    { -1, 0, 0, 0 }, // FRT2 ICI
+    { VECTOR_INTERNAL_INTERRUPT_B4, DEV_IPRC, 4, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_B8, DEV_IPRC, 4, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_BC, DEV_IPRC, 4, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_C0, DEV_IPRC, 0, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_C4, DEV_IPRC, 0, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_C8, DEV_IPRC, 0, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_E0, DEV_IPRD, 0, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_D4, DEV_IPRD, 4, 0 },
+    { VECTOR_INTERNAL_INTERRUPT_D8, DEV_IPRD, 4, 0 },
+};
+
 void MCU_Interrupt_Handle(mcu_t& mcu)
 {
 #if 0
@@ -97,15 +140,12 @@ void MCU_Interrupt_Handle(mcu_t& mcu)
         return;
     }
 #endif
-    uint32_t i;
-    for (i = 0; i < 16; i++)
+    if (mcu.trapa_pending)
     {
-        if (mcu.trapa_pending[i])
-        {
-            mcu.trapa_pending[i] = 0;
-            MCU_Interrupt_StartVector(mcu, VECTOR_TRAPA_0 + i, -1);
-            return;
-        }
+        uint32_t i = std::countr_zero(mcu.trapa_pending);
+        mcu.trapa_pending &= ~(1 << i);
+        MCU_Interrupt_StartVector(mcu, VECTOR_TRAPA_0 + i, -1);
+        return;
     }
     if (mcu.exception_pending >= 0)
     {
@@ -125,102 +165,34 @@ void MCU_Interrupt_Handle(mcu_t& mcu)
         mcu.exception_pending = -1;
         return;
     }
-    if (mcu.interrupt_pending[INTERRUPT_SOURCE_NMI])
+    if (mcu.interrupt_pending & (1u << INTERRUPT_SOURCE_NMI))
     {
-        // mcu.interrupt_pending[INTERRUPT_SOURCE_NMI] = 0;
+        // mcu.interrupt_pending &= ~(1u << INTERRUPT_SOURCE_NMI);
         MCU_Interrupt_StartVector(mcu, VECTOR_NMI, 7);
         return;
     }
-    uint32_t mask = (mcu.sr >> 8) & 7;
-    for (i = INTERRUPT_SOURCE_NMI + 1; i < INTERRUPT_SOURCE_MAX; i++)
+    int32_t mask = (mcu.sr >> 8) & 7;
+    uint32_t pending = mcu.interrupt_pending;
+    while (pending)
     {
-        int32_t vector = -1;
-        int32_t level = 0;
-        if (!mcu.interrupt_pending[i])
+        uint32_t i = std::countr_zero(pending);
+        pending &= pending - 1;
+
+        const interrupt_source_t& source = MCU_Interrupt_Sources[i];
+        if (source.vector < 0)
             continue;
-        switch (i)
-        {
-            case INTERRUPT_SOURCE_IRQ0:
-                if ((mcu.dev_register[DEV_P1CR] & 0x20) == 0)
-                    continue;
-                vector = VECTOR_IRQ0;
-                level = (mcu.dev_register[DEV_IPRA] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_IRQ1:
-                if ((mcu.dev_register[DEV_P1CR] & 0x40) == 0)
-                    continue;
-                vector = VECTOR_IRQ1;
-                level = (mcu.dev_register[DEV_IPRA] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT0_OCIA:
-                vector = VECTOR_INTERNAL_INTERRUPT_94;
-                level = (mcu.dev_register[DEV_IPRB] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT0_OCIB:
-                vector = VECTOR_INTERNAL_INTERRUPT_98;
-                level = (mcu.dev_register[DEV_IPRB] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT0_FOVI:
-                vector = VECTOR_INTERNAL_INTERRUPT_9C;
-                level = (mcu.dev_register[DEV_IPRB] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT1_OCIA:
-                vector = VECTOR_INTERNAL_INTERRUPT_A4;
-                level = (mcu.dev_register[DEV_IPRB] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT1_OCIB:
-                vector = VECTOR_INTERNAL_INTERRUPT_A8;
-                level = (mcu.dev_register[DEV_IPRB] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT1_FOVI:
-                vector = VECTOR_INTERNAL_INTERRUPT_AC;
-                level = (mcu.dev_register[DEV_IPRB] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT2_OCIA:
-                vector = VECTOR_INTERNAL_INTERRUPT_B4;
-                level = (mcu.dev_register[DEV_IPRC] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT2_OCIB:
-                vector = VECTOR_INTERNAL_INTERRUPT_B8;
-                level = (mcu.dev_register[DEV_IPRC] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_FRT2_FOVI:
-                vector = VECTOR_INTERNAL_INTERRUPT_BC;
-                level = (mcu.dev_register[DEV_IPRC] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_TIMER_CMIA:
-                vector = VECTOR_INTERNAL_INTERRUPT_C0;
-                level = (mcu.dev_register[DEV_IPRC] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_TIMER_CMIB:
-                vector = VECTOR_INTERNAL_INTERRUPT_C4;
-                level = (mcu.dev_register[DEV_IPRC] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_TIMER_OVI:
-                vector = VECTOR_INTERNAL_INTERRUPT_C8;
-                level = (mcu.dev_register[DEV_IPRC] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_ANALOG:
-                vector = VECTOR_INTERNAL_INTERRUPT_E0;
-                level = (mcu.dev_register[DEV_IPRD] >> 0) & 7;
-                break;
-            case INTERRUPT_SOURCE_UART_RX:
-                vector = VECTOR_INTERNAL_INTERRUPT_D4;
-                level = (mcu.dev_register[DEV_IPRD] >> 4) & 7;
-                break;
-            case INTERRUPT_SOURCE_UART_TX:
-                vector = VECTOR_INTERNAL_INTERRUPT_D8;
-                level = (mcu.dev_register[DEV_IPRD] >> 4) & 7;
-                break;
-            default:
-                break;
-        }
+        if (source.p1cr && (mcu.dev_register[DEV_P1CR] & source.p1cr) == 0)
+            continue;
+        int32_t level = (mcu.dev_register[source.ipr] >> source.shift) & 7;
 
-        if ((int32_t)mask < level)
+        if (mask < level)
         {
-            // mcu.interrupt_pending[INTERRUPT_SOURCE_NMI] = 0;
-            MCU_Interrupt_StartVector(mcu, vector, level);
+            // mcu.interrupt_pending &= ~(1u << INTERRUPT_SOURCE_NMI);
+            MCU_Interrupt_StartVector(mcu, source.vector, level);
             return;
         }
     }
+
+    // nothing can be taken until a request, sr or the interrupt control registers change
+    mcu.interrupt_check = 0;
 }
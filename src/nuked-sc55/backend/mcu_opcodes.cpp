@@ -38,102 +38,64 @@
 
 int32_t MCU_SUB_Common(mcu_t& mcu, int32_t t1, int32_t t2, int32_t c_bit, uint32_t siz)
 {
-    int32_t st1, st2;
-    int32_t N, Z, C, V = 0;
-    if (siz)
-    {
-        st1 = (int16_t)t1;
-        st2 = (int16_t)t2;
-        t1 = (uint16_t)t1;
-        t2 = (uint16_t)t2;
-        t1 -= t2;
-        t1 -= c_bit;
-        C = (t1 >> 16) & 1;
-
-        t1 &= 0xffff;
-        N = (t1 & 0x8000) != 0;
-        Z = t1 == 0;
-
-        st1 -= st2;
-        st1 -= c_bit;
-        if (st1 < INT16_MIN || st1 > INT16_MAX)
-            V = 1;
-    }
-    else
-    {
-        st1 = (int8_t)t1;
-        st2 = (int8_t)t2;
-        t1 = (uint8_t)t1;
-        t2 = (uint8_t)t2;
-        t1 -= t2;
-        t1 -= c_bit;
-        C = (t1 >> 8) & 1;
-
-        t1 &= 0xff;
-        N = (t1 & 0x80) != 0;
-        Z = t1 == 0;
-
-        st1 -= st2;
-        st1 -= c_bit;
-        if (st1 < INT8_MIN || st1 > INT8_MAX)
-            V = 1;
-    }
-    MCU_SetStatus(mcu, N, STATUS_N);
-    MCU_SetStatus(mcu, Z, STATUS_Z);
-    MCU_SetStatus(mcu, C, STATUS_C);
-    MCU_SetStatus(mcu, V, STATUS_V);
-
-    return t1;
+    const uint32_t mask = siz ? 0xffff : 0xff;
+    mcu.flags_op = FLAGS_SUB;
+    mcu.flags_word = siz != 0;
+    mcu.flags_carry = (uint8_t)c_bit;
+    mcu.flags_t1 = (uint16_t)(t1 & mask);
+    mcu.flags_t2 = (uint16_t)(t2 & mask);
+
+    return ((uint32_t)t1 - (uint32_t)t2 - (uint32_t)c_bit) & mask;
 }
 
 int32_t MCU_ADD_Common(mcu_t& mcu, int32_t t1, int32_t t2, int32_t c_bit, uint32_t siz)
 {
-    int32_t st1, st2;
-    int32_t N, Z, C, V = 0;
-    if (siz)
-    {
-        st1 = (int16_t)t1;
-        st2 = (int16_t)t2;
-        t1 = (uint16_t)t1;
-        t2 = (uint16_t)t2;
-        t1 += t2;
-        t1 += c_bit;
-        C = (t1 >> 16) & 1;
-
-        t1 &= 0xffff;
-        N = (t1 & 0x8000) != 0;
-        Z = t1 == 0;
-
-        st1 += st2;
-        st1 += c_bit;
-        if (st1 < INT16_MIN || st1 > INT16_MAX)
-            V = 1;
-    }
-    else
-    {
-        st1 = (int8_t)t1;
-        st2 = (int8_t)t2;
-        t1 = (uint8_t)t1;
-        t2 = (uint8_t)t2;
-        t1 += t2;
-        t1 += c_bit;
-        C = (t1 >> 8) & 1;
-
-        t1 &= 0xff;
-        N = (t1 & 0x80) != 0;
-        Z = t1 == 0;
+    const uint32_t mask = siz ? 0xffff : 0xff;
+    mcu.flags_op = FLAGS_ADD;
+    mcu.flags_word = siz != 0;
+    mcu.flags_carry = (uint8_t)c_bit;
+    mcu.flags_t1 = (uint16_t)(t1 & mask);
+    mcu.flags_t2 = (uint16_t)(t2 & mask);
+
+    return ((uint32_t)t1 + (uint32_t)t2 + (uint32_t)c_bit) & mask;
+}
 
-        st1 += st2;
-        st1 += c_bit;
-        if (st1 < INT8_MIN || st1 > INT8_MAX)
-            V = 1;
+// Folds the operation recorded by MCU_ADD_Common, MCU_SUB_Common or MCU_SetStatusCommon into sr.
+void MCU_EvaluateFlags(mcu_t& mcu)
+{
+    const uint32_t sign = mcu.flags_word ? 0x8000 : 0x80;
+    const uint32_t t1 = mcu.flags_t1;
+    const uint32_t t2 = mcu.flags_t2;
+    uint32_t result;
+    uint32_t flags = 0;
+    switch (mcu.flags_op)
+    {
+    case FLAGS_ADD:
+        result = t1 + t2 + mcu.flags_carry;
+        if (result & (sign << 1))
+            flags |= STATUS_C;
+        if (~(t1 ^ t2) & (t1 ^ result) & sign)
+            flags |= STATUS_V;
+        break;
+    case FLAGS_SUB:
+        result = t1 - t2 - mcu.flags_carry;
+        if (result & (sign << 1))
+            flags |= STATUS_C;
+        if ((t1 ^ t2) & (t1 ^ result) & sign)
+            flags |= STATUS_V;
+        break;
+    default: // FLAGS_LOGIC
+        result = t1;
+        flags |= mcu.sr & STATUS_C;
+        break;
     }
-    MCU_SetStatus(mcu, N, STATUS_N);
-    MCU_SetStatus(mcu, Z, STATUS_Z);
-    MCU_SetStatus(mcu, C, STATUS_C);
-    MCU_SetStatus(mcu, V, STATUS_V);
-
-    return t1;
+    result &= (sign << 1) - 1;
+    if (result & sign)
+        flags |= STATUS_N;
+    if (result == 0)
+        flags |= STATUS_Z;
+    mcu.sr = (uint16_t)((mcu.sr & ~(STATUS_N | STATUS_Z | STATUS_V | STATUS_C)) | flags);
+    mcu.flags_op = FLAGS_NONE;
 }
 
 void MCU_Operand_Nop(mcu_t& mcu, uint8_t operand)
@@ -252,9 +214,11 @@ void MCU_Jump_RTE(mcu_t& mcu, uint8_t operand)
 {
     (void)operand;
     mcu.sr = MCU_PopStack(mcu);
+    mcu.flags_op = FLAGS_NONE;
     mcu.cp = (uint8_t)MCU_PopStack(mcu);
     mcu.pc = MCU_PopStack(mcu);
     mcu.ex_ignore = 1;
+    mcu.interrupt_check = 1;
 }
 
 void MCU_Jump_Bcc(mcu_t& mcu, uint8_t operand)
@@ -274,6 +238,7 @@ void MCU_Jump_Bcc(mcu_t& mcu, uint8_t operand)
     }
     cond = operand & 0x0f;
 
+    MCU_SyncFlags(mcu);
     N = (mcu.sr & STATUS_N) != 0;
     C = (mcu.sr & STATUS_C) != 0;
     Z = (mcu.sr & STATUS_Z) != 0;
@@ -433,6 +398,7 @@ void MCU_Jump_JMP(mcu_t& mcu, uint8_t operand)
         if (opcode == 0x17)
         {
             uint16_t disp = (int8_t)MCU_ReadCodeAdvance(mcu);
+            MCU_SyncFlags(mcu);
             uint32_t Z = (mcu.sr & STATUS_Z) != 0;
             if (Z)
             {
@@ -456,6 +422,7 @@ void MCU_Jump_JMP(mcu_t& mcu, uint8_t operand)
         if (opcode == 0x17)
         {
             uint16_t disp = (int8_t)MCU_ReadCodeAdvance(mcu);
+            MCU_SyncFlags(mcu);
             uint32_t Z = (mcu.sr & STATUS_Z) != 0;
             if (!Z)
             {
@@ -562,27 +529,14 @@ void MCU_Operand_Write(mcu_t& mcu, uint32_t data)
     }
 }
 
-void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
+static void MCU_Operand_GeneralDecode(mcu_t& mcu, uint8_t operand, mcu_decoded_t& dec)
 {
     uint32_t type = GENERAL_DIRECT;
-    uint32_t disp = 0;
     uint32_t increase = INCREASE_NONE;
-    uint32_t absolute = 0;
-    (void)absolute; // unused
-    uint32_t reg = 0;
-    uint32_t siz = OPERAND_BYTE;
-    uint32_t data = 0;
-    uint32_t addr = 0;
-    uint32_t addrpage = 0;
-    uint32_t ea = 0;
-    uint32_t ep = 0;
+    uint32_t reg = operand & 0x07;
+    uint32_t siz = (operand & 0x08) ? OPERAND_WORD : OPERAND_BYTE;
+    uint32_t value = 0;
     uint8_t opcode;
-    uint8_t opcode_reg;
-    if (operand & 0x08)
-        siz = OPERAND_WORD;
-    else
-        siz = OPERAND_BYTE;
-    reg = operand & 0x07;
     switch (operand & 0xf0)
     {
     case 0xa0:
@@ -593,13 +547,13 @@ void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
         break;
     case 0xe0:
         type = GENERAL_INDIRECT;
-        disp = (int8_t)MCU_ReadCodeAdvance(mcu);
+        value = (int8_t)MCU_ReadCodeAdvance(mcu);
         break;
     case 0xf0:
         type = GENERAL_INDIRECT;
-        disp = MCU_ReadCodeAdvance(mcu);
-        disp <<= 8;
-        disp |= MCU_ReadCodeAdvance(mcu);
+        value = MCU_ReadCodeAdvance(mcu);
+        value <<= 8;
+        value |= MCU_ReadCodeAdvance(mcu);
         break;
     case 0xb0:
         type = GENERAL_INDIRECT;
@@ -613,18 +567,16 @@ void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
         if (reg == 5)
         {
             type = GENERAL_ABSOLUTE;
-            addr = mcu.br << 8;
-            addr |= MCU_ReadCodeAdvance(mcu);
-            addrpage = 0;
+            value = MCU_ReadCodeAdvance(mcu); // low byte, page comes from br
         }
         else if (reg == 4)
         {
             type = GENERAL_IMMEDIATE;
-            data = MCU_ReadCodeAdvance(mcu);
+            value = MCU_ReadCodeAdvance(mcu);
             if (siz)
             {
-                data <<= 8;
-                data |= MCU_ReadCodeAdvance(mcu);
+                value <<= 8;
+                value |= MCU_ReadCodeAdvance(mcu);
             }
         }
         break;
@@ -632,15 +584,37 @@ void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
         if (reg == 5)
         {
             type = GENERAL_ABSOLUTE;
-            addr = MCU_ReadCodeAdvance(mcu) << 8;
-            addr |= MCU_ReadCodeAdvance(mcu);
-            addrpage = mcu.dp;
+            value = MCU_ReadCodeAdvance(mcu) << 8;
+            value |= MCU_ReadCodeAdvance(mcu);
         }
         break;
     }
-    if (type == GENERAL_INDIRECT)
+
+    opcode = MCU_ReadCodeAdvance(mcu);
+    dec.extended = opcode == 0x00;
+    if (dec.extended)
     {
-        if (increase == INCREASE_DECREASE)
+        opcode = MCU_ReadCodeAdvance(mcu);
+    }
+
+    dec.general = 1;
+    dec.type = type;
+    dec.increase = increase;
+    dec.value = value;
+    dec.opcode = opcode >> 3;
+    dec.opcode_reg = opcode & 0x07;
+}
+
+static void MCU_Operand_GeneralExecute(mcu_t& mcu, const mcu_decoded_t& dec)
+{
+    uint32_t reg = dec.operand & 0x07;
+    uint32_t siz = (dec.operand & 0x08) ? OPERAND_WORD : OPERAND_BYTE;
+    uint32_t data = 0;
+    uint32_t ea = 0;
+    uint32_t ep = 0;
+    if (dec.type == GENERAL_INDIRECT)
+    {
+        if (dec.increase == INCREASE_DECREASE)
         {
             if (siz || reg == 7)
             {
@@ -651,8 +625,8 @@ void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
                 mcu.r[reg] -= 1;
             }
         }
-        ea = mcu.r[reg] + disp;
-        if (increase == INCREASE_INCREASE)
+        ea = mcu.r[reg] + dec.value;
+        if (dec.increase == INCREASE_INCREASE)
         {
             if (siz || reg == 7)
             {
@@ -668,23 +642,27 @@ void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
 
         ep = MCU_GetPageForRegister(mcu, reg) & 0xff;
     }
-    else if (type == GENERAL_ABSOLUTE)
+    else if (dec.type == GENERAL_ABSOLUTE)
     {
-        ea = addr & 0xffff;
-
-        ep = addrpage & 0xff;
+        if (dec.operand & 0x10)
+        {
+            ea = dec.value;
+            ep = mcu.dp;
+        }
+        else
+        {
+            ea = (mcu.br << 8) | dec.value;
+            ep = 0;
+        }
     }
-
-    opcode = MCU_ReadCodeAdvance(mcu);
-    mcu.opcode_extended = opcode == 0x00;
-    if (mcu.opcode_extended)
+    else if (dec.type == GENERAL_IMMEDIATE)
     {
-        opcode = MCU_ReadCodeAdvance(mcu);
+        data = dec.value;
     }
-    opcode_reg = opcode & 0x07;
-    opcode >>= 3;
 
-    mcu.operand_type = type;
+    mcu.opcode_extended = dec.extended;
+
+    mcu.operand_type = dec.type;
     mcu.operand_ea = ea;
     mcu.operand_ep = ep;
     mcu.operand_size = siz;
@@ -692,21 +670,43 @@ void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
     mcu.operand_data = data;
     mcu.operand_status = 0;
 
-    MCU_Opcode_Table[opcode](mcu, opcode, opcode_reg);
+    MCU_Opcode_Table[dec.opcode](mcu, dec.opcode, dec.opcode_reg);
 }
 
-void MCU_SetStatusCommon(mcu_t& mcu, uint32_t val, uint32_t siz)
+void MCU_Operand_General(mcu_t& mcu, uint8_t operand)
 {
-    if (siz)
-        val &= 0xffff;
-    else
-        val &= 0xff;
-    if (siz)
-        MCU_SetStatus(mcu, val & 0x8000, STATUS_N);
+    mcu_decoded_t dec;
+    dec.operand = operand;
+    MCU_Operand_GeneralDecode(mcu, operand, dec);
+    MCU_Operand_GeneralExecute(mcu, dec);
+}
+
+void MCU_Operand_Decode(mcu_t& mcu, mcu_decoded_t& dec)
+{
+    uint16_t pc = mcu.pc;
+    dec.operand = MCU_ReadCodeAdvance(mcu);
+    dec.general = 0;
+    if (MCU_Operand_Table[dec.operand] == MCU_Operand_General)
+        MCU_Operand_GeneralDecode(mcu, dec.operand, dec);
+    dec.length = (uint16_t)(mcu.pc - pc);
+}
+
+void MCU_Operand_Execute(mcu_t& mcu, const mcu_decoded_t& dec)
+{
+    if (dec.general)
+        MCU_Operand_GeneralExecute(mcu, dec);
     else
-        MCU_SetStatus(mcu, val & 0x80, STATUS_N);
-    MCU_SetStatus(mcu, val == 0, STATUS_Z);
-    MCU_SetStatus(mcu, 0, STATUS_V);
+        MCU_Operand_Table[dec.operand](mcu, dec.operand);
+}
+
+void MCU_SetStatusCommon(mcu_t& mcu, uint32_t val, uint32_t siz)
+{
+    // C is kept, so a pending ADD/SUB has to be folded in before it is replaced
+    if (mcu.flags_op != FLAGS_LOGIC)
+        MCU_SyncFlags(mcu);
+    mcu.flags_op = FLAGS_LOGIC;
+    mcu.flags_word = siz != 0;
+    mcu.flags_t1 = (uint16_t)(siz ? val & 0xffff : val & 0xff);
 }
 
 void MCU_Opcode_Short_NotImplemented(mcu_t& mcu, uint8_t opcode)
@@ -1284,6 +1284,7 @@ void MCU_Opcode_SHLR(mcu_t& mcu, uint8_t opcode, uint8_t opcode_reg)
     else if (opcode_reg == 0x06 && mcu.operand_type != GENERAL_IMMEDIATE) // ROTXL
     {
         uint32_t data = MCU_Operand_Read(mcu);
+        MCU_SyncFlags(mcu);
         uint32_t bit = (mcu.sr & STATUS_C) != 0;
         uint32_t C;
         if (mcu.operand_size)
@@ -1481,6 +1482,7 @@ void MCU_Opcode_ADDX(mcu_t& mcu, uint8_t opcode, uint8_t opcode_reg)
     (void)opcode;
     int32_t t1 = mcu.r[opcode_reg];
     int32_t t2 = MCU_Operand_Read(mcu);
+    MCU_SyncFlags(mcu);
     int32_t C = (mcu.sr & STATUS_C) != 0;
     int32_t Z = (mcu.sr & STATUS_Z) != 0;
     t1 = MCU_ADD_Common(mcu, t1, t2, C, mcu.operand_size);
@@ -1501,6 +1503,7 @@ void MCU_Opcode_SUBX(mcu_t& mcu, uint8_t opcode, uint8_t opcode_reg)
     (void)opcode;
     int32_t t1 = mcu.r[opcode_reg];
     int32_t t2 = MCU_Operand_Read(mcu);
+    MCU_SyncFlags(mcu);
     int32_t C = (mcu.sr & STATUS_C) != 0;
     t1 = MCU_SUB_Common(mcu, t1, t2, C, mcu.operand_size);
     if (mcu.operand_size)
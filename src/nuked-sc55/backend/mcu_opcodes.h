@@ -37,6 +37,19 @@
 #include <cstdint>
 
 struct mcu_t;
+struct mcu_decoded_t;
 
 extern void (*MCU_Operand_Table[256])(mcu_t& mcu, uint8_t operand);
 extern void (*MCU_Opcode_Table[32])(mcu_t& mcu, uint8_t opcode, uint8_t opcode_reg);
+
+// Arithmetic on byte (siz == 0) or word operands. The flags are only recorded here and folded into sr by
+// MCU_SyncFlags.
+int32_t MCU_ADD_Common(mcu_t& mcu, int32_t t1, int32_t t2, int32_t c_bit, uint32_t siz);
+int32_t MCU_SUB_Common(mcu_t& mcu, int32_t t1, int32_t t2, int32_t c_bit, uint32_t siz);
+// Sets N and Z from val and clears V, keeping C
+void MCU_SetStatusCommon(mcu_t& mcu, uint32_t val, uint32_t siz);
+
+// Decodes the instruction at cp:pc into dec and advances pc past the bytes the decoder consumed. Operand bytes
+// read by the opcode handlers themselves (branch targets, register lists, etc.) are not part of the decoded length.
+void MCU_Operand_Decode(mcu_t& mcu, mcu_decoded_t& dec);
+void MCU_Operand_Execute(mcu_t& mcu, const mcu_decoded_t& dec);
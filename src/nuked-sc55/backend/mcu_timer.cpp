@@ -34,6 +34,7 @@
 
 #include "mcu_timer.h"
 #include "mcu.h"
+#include <algorithm>
 #include <cstdint>
 
 enum {
@@ -56,6 +57,7 @@ void TIMER_Init(mcu_timer_t& timer, mcu_t& mcu)
 
 void TIMER_Write(mcu_timer_t& timer, uint32_t address, uint8_t data)
 {
+    TIMER_Clock(timer, timer.mcu->cycles);
     uint32_t t = (address >> 4) - 1;
     if (t > 2)
         return;
@@ -111,6 +113,7 @@ void TIMER_Write(mcu_timer_t& timer, uint32_t address, uint8_t data)
 
 uint8_t TIMER_Read(mcu_timer_t& timer, uint32_t address)
 {
+    TIMER_Clock(timer, timer.mcu->cycles);
     uint32_t t = (address >> 4) - 1;
     if (t > 2)
         return 0xff;
@@ -150,6 +153,7 @@ uint8_t TIMER_Read(mcu_timer_t& timer, uint32_t address)
 
 void TIMER2_Write(mcu_timer_t& timer, uint32_t address, uint8_t data)
 {
+    TIMER_Clock(timer, timer.mcu->cycles);
     switch (address)
     {
     case DEV_TMR_TCR:
@@ -190,6 +194,7 @@ void TIMER2_Write(mcu_timer_t& timer, uint32_t address, uint8_t data)
 }
 uint8_t TIMER_Read2(mcu_timer_t& timer, uint32_t address)
 {
+    TIMER_Clock(timer, timer.mcu->cycles);
     switch (address)
     {
     case DEV_TMR_TCR:
@@ -226,81 +231,212 @@ constexpr uint64_t TIMER_STEP_TABLE_MK1[8] = {
     0, 7, 63, 1023, 0, 3, 3, 3
 };
 
+static const uint64_t TIMER_NEVER = UINT64_MAX;
+
+// The counters are handled in closed form. Between register accesses a counter only counts, optionally
+// clearing to 0 when it matches `clear` (-1 for no clearing), so the value it holds at each prescaled step is
+// known in advance. Flags are sticky, so all that matters within a TIMER_Clock call is whether a compare value
+// or the overflow point is passed, and the value the counter ends up with.
+
+// Step index (0-based) at which the counter first holds `target`, or TIMER_NEVER.
+static uint64_t TIMER_FirstMatch(uint32_t value, uint32_t target, uint32_t range, int32_t clear)
+{
+    if (clear < 0)
+        return (target - value) & (range - 1);
+    uint32_t period = clear + 1;
+    if (value <= (uint32_t)clear)
+        return target <= (uint32_t)clear ? (target + period - value) % period : TIMER_NEVER;
+    // counts up to the top, overflows to 0 and then cycles below `clear`
+    if (target >= value)
+        return target - value;
+    if (target <= (uint32_t)clear)
+        return range - value + target;
+    return TIMER_NEVER;
+}
+
+// Step index at which the counter overflows, or TIMER_NEVER.
+static uint64_t TIMER_FirstOverflow(uint32_t value, uint32_t range, int32_t clear)
+{
+    if (clear >= 0 && value <= (uint32_t)clear)
+        return TIMER_NEVER;
+    return range - 1 - value;
+}
+
+static uint32_t TIMER_Advance(uint32_t value, uint64_t steps, uint32_t range, int32_t clear)
+{
+    if (clear < 0)
+        return (value + steps) & (range - 1);
+    uint32_t period = clear + 1;
+    if (value <= (uint32_t)clear)
+        return (value + steps) % period;
+    if (steps < range - value)
+        return value + (uint32_t)steps;
+    return (steps - (range - value)) % period;
+}
+
+// Number of ticks in [from, to) on which a counter with the given prescaler mask steps.
+static uint64_t TIMER_StepCount(uint64_t from, uint64_t to, uint64_t mask)
+{
+    return (to + mask) / (mask + 1) - (from + mask) / (mask + 1);
+}
+
+// Tick on which the counter takes its step number `step` counted from tick `from`.
+static uint64_t TIMER_StepTick(uint64_t from, uint64_t step, uint64_t mask)
+{
+    return ((from + mask) & ~mask) + step * (mask + 1);
+}
+
+static int32_t TIMER_ClearValue(const mcu_timer_t& timer)
+{
+    if ((timer.tcr & 24) == 8)
+        return timer.tcora;
+    if ((timer.tcr & 24) == 16)
+        return timer.tcorb;
+    return -1;
+}
+
+template <RomsetFamily family>
 void TIMER_Clock(mcu_timer_t& timer, uint64_t cycles)
 {
-    const bool mk1 = timer.mcu->is_mk1;
+    constexpr bool mk1 = family == RomsetFamily::MK1;
     const auto& FRT_STEP_TABLE = mk1 ? FRT_STEP_TABLE_MK1 : FRT_STEP_TABLE_GENERIC;
     const auto& TIMER_STEP_TABLE = mk1 ? TIMER_STEP_TABLE_MK1 : TIMER_STEP_TABLE_GENERIC;
 
-    while (timer.cycles*2 < cycles) // FIXME
+    const uint64_t target = (cycles + 1) / 2; // FIXME
+    if (timer.cycles >= target)
+        return;
+
+    for (int i = 0; i < 3; i++)
     {
-        for (int i = 0; i < 3; i++)
-        {
-            frt_t *ftimer = &timer.frt[i];
-
-            const bool frt_step = !(timer.cycles & FRT_STEP_TABLE[ftimer->tcr & 3]);
-
-            if (frt_step)
-            {
-                uint32_t value = ftimer->frc;
-                uint32_t matcha = value == ftimer->ocra;
-                uint32_t matchb = value == ftimer->ocrb;
-                if ((ftimer->tcsr & 1) != 0 && matcha) // CCLRA
-                    value = 0;
-                else
-                    value++;
-                uint32_t of = (value >> 16) & 1;
-                value &= 0xffff;
-                ftimer->frc = value;
-
-                // flags
-                if (of)
-                    ftimer->tcsr |= 0x10;
-                if (matcha)
-                    ftimer->tcsr |= 0x20;
-                if (matchb)
-                    ftimer->tcsr |= 0x40;
-                if ((ftimer->tcr & 0x10) != 0 && (ftimer->tcsr & 0x10) != 0)
-                    MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_FRT0_FOVI + i * 4, 1);
-                if ((ftimer->tcr & 0x20) != 0 && (ftimer->tcsr & 0x20) != 0)
-                    MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_FRT0_OCIA + i * 4, 1);
-                if ((ftimer->tcr & 0x40) != 0 && (ftimer->tcsr & 0x40) != 0)
-                    MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_FRT0_OCIB + i * 4, 1);
-            }
-        }
+        frt_t *ftimer = &timer.frt[i];
 
-        const bool timer_step = !(timer.cycles & TIMER_STEP_TABLE[timer.tcr & 7]);
+        const uint64_t steps = TIMER_StepCount(timer.cycles, target, FRT_STEP_TABLE[ftimer->tcr & 3]);
 
-        if (timer_step)
+        if (steps)
         {
-            uint32_t value = timer.tcnt;
-            uint32_t matcha = value == timer.tcora;
-            uint32_t matchb = value == timer.tcorb;
-            if ((timer.tcr & 24) == 8 && matcha)
-                value = 0;
-            else if ((timer.tcr & 24) == 16 && matchb)
-                value = 0;
-            else
-                value++;
-            uint32_t of = (value >> 8) & 1;
-            value &= 0xff;
-            timer.tcnt = value;
+            const int32_t clear = (ftimer->tcsr & 1) != 0 ? ftimer->ocra : -1; // CCLRA
+            const uint32_t value = ftimer->frc;
 
             // flags
-            if (of)
-                timer.tcsr |= 0x20;
-            if (matcha)
-                timer.tcsr |= 0x40;
-            if (matchb)
-                timer.tcsr |= 0x80;
-            if ((timer.tcr & 0x20) != 0 && (timer.tcsr & 0x20) != 0)
-                MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_TIMER_OVI, 1);
-            if ((timer.tcr & 0x40) != 0 && (timer.tcsr & 0x40) != 0)
-                MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_TIMER_CMIA, 1);
-            if ((timer.tcr & 0x80) != 0 && (timer.tcsr & 0x80) != 0)
-                MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_TIMER_CMIB, 1);
+            if (TIMER_FirstOverflow(value, 0x10000, clear) < steps)
+                ftimer->tcsr |= 0x10;
+            if (TIMER_FirstMatch(value, ftimer->ocra, 0x10000, clear) < steps)
+                ftimer->tcsr |= 0x20;
+            if (TIMER_FirstMatch(value, ftimer->ocrb, 0x10000, clear) < steps)
+                ftimer->tcsr |= 0x40;
+            ftimer->frc = TIMER_Advance(value, steps, 0x10000, clear);
+
+            if ((ftimer->tcr & 0x10) != 0 && (ftimer->tcsr & 0x10) != 0)
+                MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_FRT0_FOVI + i * 4, 1);
+            if ((ftimer->tcr & 0x20) != 0 && (ftimer->tcsr & 0x20) != 0)
+                MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_FRT0_OCIA + i * 4, 1);
+            if ((ftimer->tcr & 0x40) != 0 && (ftimer->tcsr & 0x40) != 0)
+                MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_FRT0_OCIB + i * 4, 1);
         }
+    }
+
+    const uint64_t steps = TIMER_StepCount(timer.cycles, target, TIMER_STEP_TABLE[timer.tcr & 7]);
 
-        timer.cycles++;
+    if (steps)
+    {
+        const int32_t clear = TIMER_ClearValue(timer);
+        const uint32_t value = timer.tcnt;
+
+        // flags
+        if (TIMER_FirstOverflow(value, 0x100, clear) < steps)
+            timer.tcsr |= 0x20;
+        if (TIMER_FirstMatch(value, timer.tcora, 0x100, clear) < steps)
+            timer.tcsr |= 0x40;
+        if (TIMER_FirstMatch(value, timer.tcorb, 0x100, clear) < steps)
+            timer.tcsr |= 0x80;
+        timer.tcnt = TIMER_Advance(value, steps, 0x100, clear);
+
+        if ((timer.tcr & 0x20) != 0 && (timer.tcsr & 0x20) != 0)
+            MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_TIMER_OVI, 1);
+        if ((timer.tcr & 0x40) != 0 && (timer.tcsr & 0x40) != 0)
+            MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_TIMER_CMIA, 1);
+        if ((timer.tcr & 0x80) != 0 && (timer.tcsr & 0x80) != 0)
+            MCU_Interrupt_SetRequest(*timer.mcu, INTERRUPT_SOURCE_TIMER_CMIB, 1);
     }
+
+    timer.cycles = target;
+}
+
+template void TIMER_Clock<RomsetFamily::MK2>(mcu_timer_t& timer, uint64_t cycles);
+template void TIMER_Clock<RomsetFamily::MK1>(mcu_timer_t& timer, uint64_t cycles);
+template void TIMER_Clock<RomsetFamily::JV880>(mcu_timer_t& timer, uint64_t cycles);
+template void TIMER_Clock<RomsetFamily::SCB55>(mcu_timer_t& timer, uint64_t cycles);
+
+void TIMER_Clock(mcu_timer_t& timer, uint64_t cycles)
+{
+    // only the prescaler tables differ between families
+    if (timer.mcu->family == RomsetFamily::MK1)
+        TIMER_Clock<RomsetFamily::MK1>(timer, cycles);
+    else
+        TIMER_Clock<RomsetFamily::MK2>(timer, cycles);
+}
+
+// Earliest tick at which a flag with its interrupt enabled raises a request that is not already pending.
+static uint64_t TIMER_NextRequest(mcu_t& mcu, uint64_t from, uint64_t mask, uint8_t tcsr, uint8_t enable,
+    uint8_t flag, uint32_t interrupt, uint64_t first)
+{
+    if ((enable & flag) == 0)
+        return TIMER_NEVER;
+    if ((tcsr & flag) != 0)
+        return (mcu.interrupt_pending >> interrupt) & 1 ? TIMER_NEVER : TIMER_StepTick(from, 0, mask);
+    return first == TIMER_NEVER ? TIMER_NEVER : TIMER_StepTick(from, first, mask);
+}
+
+template <RomsetFamily family>
+uint64_t TIMER_NextEvent(const mcu_timer_t& timer)
+{
+    mcu_t& mcu = *timer.mcu;
+    constexpr bool mk1 = family == RomsetFamily::MK1;
+    const auto& FRT_STEP_TABLE = mk1 ? FRT_STEP_TABLE_MK1 : FRT_STEP_TABLE_GENERIC;
+    const auto& TIMER_STEP_TABLE = mk1 ? TIMER_STEP_TABLE_MK1 : TIMER_STEP_TABLE_GENERIC;
+
+    uint64_t next = TIMER_NEVER;
+
+    for (int i = 0; i < 3; i++)
+    {
+        const frt_t *ftimer = &timer.frt[i];
+        const uint64_t mask = FRT_STEP_TABLE[ftimer->tcr & 3];
+        const int32_t clear = (ftimer->tcsr & 1) != 0 ? ftimer->ocra : -1;
+        const uint32_t value = ftimer->frc;
+
+        next = std::min(next, TIMER_NextRequest(mcu, timer.cycles, mask, ftimer->tcsr,
+            ftimer->tcr, 0x10, INTERRUPT_SOURCE_FRT0_FOVI + i * 4, TIMER_FirstOverflow(value, 0x10000, clear)));
+        next = std::min(next, TIMER_NextRequest(mcu, timer.cycles, mask, ftimer->tcsr,
+            ftimer->tcr, 0x20, INTERRUPT_SOURCE_FRT0_OCIA + i * 4, TIMER_FirstMatch(value, ftimer->ocra, 0x10000, clear)));
+        next = std::min(next, TIMER_NextRequest(mcu, timer.cycles, mask, ftimer->tcsr,
+            ftimer->tcr, 0x40, INTERRUPT_SOURCE_FRT0_OCIB + i * 4, TIMER_FirstMatch(value, ftimer->ocrb, 0x10000, clear)));
+    }
+
+    const uint64_t mask = TIMER_STEP_TABLE[timer.tcr & 7];
+    const int32_t clear = TIMER_ClearValue(timer);
+    const uint32_t value = timer.tcnt;
+
+    next = std::min(next, TIMER_NextRequest(mcu, timer.cycles, mask, timer.tcsr,
+        timer.tcr, 0x20, INTERRUPT_SOURCE_TIMER_OVI, TIMER_FirstOverflow(value, 0x100, clear)));
+    next = std::min(next, TIMER_NextRequest(mcu, timer.cycles, mask, timer.tcsr,
+        timer.tcr, 0x40, INTERRUPT_SOURCE_TIMER_CMIA, TIMER_FirstMatch(value, timer.tcora, 0x100, clear)));
+    next = std::min(next, TIMER_NextRequest(mcu, timer.cycles, mask, timer.tcsr,
+        timer.tcr, 0x80, INTERRUPT_SOURCE_TIMER_CMIB, TIMER_FirstMatch(value, timer.tcorb, 0x100, clear)));
+
+    if (next == TIMER_NEVER)
+        return TIMER_NEVER;
+    // tick t is processed by the first TIMER_Clock call with cycles > 2 * t
+    return next * 2 + 1;
+}
+
+template uint64_t TIMER_NextEvent<RomsetFamily::MK2>(const mcu_timer_t& timer);
+template uint64_t TIMER_NextEvent<RomsetFamily::MK1>(const mcu_timer_t& timer);
+template uint64_t TIMER_NextEvent<RomsetFamily::JV880>(const mcu_timer_t& timer);
+template uint64_t TIMER_NextEvent<RomsetFamily::SCB55>(const mcu_timer_t& timer);
+
+uint64_t TIMER_NextEvent(const mcu_timer_t& timer)
+{
+    if (timer.mcu->family == RomsetFamily::MK1)
+        return TIMER_NextEvent<RomsetFamily::MK1>(timer);
+    return TIMER_NextEvent<RomsetFamily::MK2>(timer);
 }
@@ -34,6 +34,7 @@
 
 #pragma once
 
+#include "rom.h"
 #include <cstdint>
 
 struct mcu_t;
@@ -68,6 +69,14 @@ void TIMER_Init(mcu_timer_t& timer, mcu_t& mcu);
 void TIMER_Write(mcu_timer_t& timer, uint32_t address, uint8_t data);
 uint8_t TIMER_Read(mcu_timer_t& timer, uint32_t address);
 void TIMER_Clock(mcu_timer_t& timer, uint64_t cycles);
+// Earliest MCU cycle count at which TIMER_Clock would raise a new interrupt request. Counter values and flags are
+// caught up lazily by the register accessors.
+uint64_t TIMER_NextEvent(const mcu_timer_t& timer);
+// Specialisations of the above for one romset family. The family must match timer.mcu->family.
+template <RomsetFamily family>
+void TIMER_Clock(mcu_timer_t& timer, uint64_t cycles);
+template <RomsetFamily family>
+uint64_t TIMER_NextEvent(const mcu_timer_t& timer);
 
 void TIMER2_Write(mcu_timer_t& timer, uint32_t address, uint8_t data);
 uint8_t TIMER_Read2(mcu_timer_t& timer, uint32_t address);
@@ -0,0 +1,102 @@
+#include "pages.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define PAGES_HAVE_MMAP
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+static const size_t PAGES_ALIGNMENT = 4096;
+#endif
+
+#ifdef PAGES_HAVE_MMAP
+static bool PAGES_UseHuge(size_t size, bool huge)
+{
+#if defined(__linux__)
+    return huge && size >= HUGE_PAGE_SIZE;
+#else
+    (void)size;
+    (void)huge;
+    return false;
+#endif
+}
+
+static size_t PAGES_RoundUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+#endif
+
+void* AllocatePages(size_t size, bool huge)
+{
+#ifdef PAGES_HAVE_MMAP
+#if defined(__linux__)
+    if (PAGES_UseHuge(size, huge))
+    {
+        const size_t length = PAGES_RoundUp(size, HUGE_PAGE_SIZE);
+
+        // Only succeeds if the administrator reserved huge pages (vm.nr_hugepages), which is rare on desktops.
+        void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            return ptr;
+        }
+
+        // Transparent huge pages need a 2 MB aligned range, so over-allocate and trim both ends.
+        void* base = mmap(nullptr, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        const uintptr_t start   = (uintptr_t)base;
+        const uintptr_t aligned = PAGES_RoundUp(start, HUGE_PAGE_SIZE);
+        if (aligned != start)
+        {
+            munmap(base, aligned - start);
+        }
+        munmap((void*)(aligned + length), start + HUGE_PAGE_SIZE - aligned);
+        madvise((void*)aligned, length, MADV_HUGEPAGE);
+        return (void*)aligned;
+    }
+#endif
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr != MAP_FAILED ? ptr : nullptr;
+#elif defined(_WIN32)
+    // Large pages need SeLockMemoryPrivilege, which normal users don't have, so `huge` is ignored here.
+    (void)huge;
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    (void)huge;
+    void* ptr = ::operator new(size, std::align_val_t{PAGES_ALIGNMENT}, std::nothrow);
+    if (ptr)
+    {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+#endif
+}
+
+void FreePages(void* ptr, size_t size, bool huge)
+{
+    if (!ptr)
+    {
+        return;
+    }
+#ifdef PAGES_HAVE_MMAP
+    munmap(ptr, PAGES_UseHuge(size, huge) ? PAGES_RoundUp(size, HUGE_PAGE_SIZE) : size);
+#elif defined(_WIN32)
+    (void)size;
+    (void)huge;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    (void)size;
+    (void)huge;
+    ::operator delete(ptr, std::align_val_t{PAGES_ALIGNMENT});
+#endif
+}
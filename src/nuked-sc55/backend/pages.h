@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Size of the huge pages AllocatePages tries to use. Allocations smaller than this always use normal pages.
+static const size_t HUGE_PAGE_SIZE = 0x200000;
+
+// Allocates `size` bytes of zeroed, page-aligned memory. Pages the caller never writes to stay unbacked where the OS
+// allows it.
+//
+// If `huge` is true and `size` is at least HUGE_PAGE_SIZE, the allocation is rounded up to whole huge pages and backed
+// by them if possible: pages reserved for MAP_HUGETLB are tried first, then transparent huge pages. Otherwise `huge`
+// has no effect. Huge pages cut TLB misses when large buffers are read all over, at the cost of backing whole 2 MB
+// pages at a time.
+//
+// Returns null if memory could not be allocated.
+void* AllocatePages(size_t size, bool huge);
+
+// Releases memory returned by AllocatePages. `size` and `huge` must be the values passed to AllocatePages.
+void FreePages(void* ptr, size_t size, bool huge);
@@ -35,11 +35,19 @@
 #include "pcm.h"
 #include "mcu.h"
 #include "mcu_interrupt.h"
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <iterator>
 
-uint8_t PCM_ReadROM(pcm_t& pcm, uint32_t address)
+template <RomsetFamily family>
+static uint8_t PCM_ReadROM(pcm_t& pcm, uint32_t address)
 {
+    constexpr bool is_mk1 = family == RomsetFamily::MK1;
+    constexpr bool is_jv880 = family == RomsetFamily::JV880;
+
     int bank;
     if (pcm.config_reg_3d & 0x20)
         bank = (address >> 21) & 7;
@@ -48,17 +56,17 @@ uint8_t PCM_ReadROM(pcm_t& pcm, uint32_t address)
     switch (bank)
     {
         case 0:
-            if (pcm.mcu->is_mk1)
+            if constexpr (is_mk1)
                 return pcm.waverom1[address & 0xfffff];
             else
                 return pcm.waverom1[address & 0x1fffff];
         case 1:
-            if (!pcm.mcu->is_jv880)
+            if constexpr (!is_jv880)
                 return pcm.waverom2[address & 0xfffff];
             else
                 return pcm.waverom2[address & 0x1fffff];
         case 2:
-            if (pcm.mcu->is_jv880)
+            if constexpr (is_jv880)
                 return pcm.waverom_card[address & 0x1fffff];
             else
                 return pcm.waverom3[address & 0xfffff];
@@ -66,7 +74,7 @@ uint8_t PCM_ReadROM(pcm_t& pcm, uint32_t address)
         case 4:
         case 5:
         case 6:
-            if (pcm.mcu->is_jv880)
+            if constexpr (is_jv880)
                 return pcm.waverom_exp[(address & 0x1fffff) + (bank - 3) * 0x200000];
         default:
             break;
@@ -74,6 +82,20 @@ uint8_t PCM_ReadROM(pcm_t& pcm, uint32_t address)
     return 0;
 }
 
+uint8_t PCM_ReadROM(pcm_t& pcm, uint32_t address)
+{
+    switch (pcm.mcu->family)
+    {
+    case RomsetFamily::MK1:
+        return PCM_ReadROM<RomsetFamily::MK1>(pcm, address);
+    case RomsetFamily::JV880:
+        return PCM_ReadROM<RomsetFamily::JV880>(pcm, address);
+    default:
+        // MK2 and SCB55 share the same wave ROM layout
+        return PCM_ReadROM<RomsetFamily::MK2>(pcm, address);
+    }
+}
+
 void PCM_Write(pcm_t& pcm, uint32_t address, uint8_t data)
 {
     address &= 0x3f;
@@ -486,7 +508,7 @@ inline void calc_tv(pcm_t& pcm, int e, int adjust, uint16_t *levelcur, int activ
     }
 }
 
-inline int eram_unpack(pcm_t& pcm, int addr, int type = 0)
+inline int eram_unpack(const pcm_t& pcm, int addr, int type = 0)
 {
     addr &= 0x3fff;
     int data = pcm.eram[addr];
@@ -583,8 +605,12 @@ void PCM_GetConfig(PCM_Config& config, uint8_t config_byte)
     }
 }
 
+template <RomsetFamily family>
 void PCM_Update(pcm_t& pcm, uint64_t cycles)
 {
+    constexpr bool is_mk1 = family == RomsetFamily::MK1;
+    constexpr bool is_jv880 = family == RomsetFamily::JV880;
+
     while (pcm.cycles < cycles)
     {
         const int voice_active = pcm.voice_mask & pcm.voice_mask_pending;
@@ -1148,7 +1174,7 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
                 wave_address += nibble_add - nibble_subtract;
             wave_address &= 0xfffff;
 
-            int newnibble = PCM_ReadROM(pcm, (hiaddr << 20) | wave_address);
+            int newnibble = PCM_ReadROM<family>(pcm, (hiaddr << 20) | wave_address);
             int newnibble_sel = address_b4 ^ ((b6 || !nibble_cmp1) && okey);
             if (newnibble_sel)
                 newnibble = (newnibble >> 4) & 15;
@@ -1168,7 +1194,7 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
 
             // address 0
             int address_cnt = address;
-            int samp0 = (int8_t)PCM_ReadROM(pcm, (hiaddr << 20) | address_cnt); // 18
+            int samp0 = (int8_t)PCM_ReadROM<family>(pcm, (hiaddr << 20) | address_cnt); // 18
 
             cmp1 = address;
             cmp2 = address_cnt;
@@ -1194,7 +1220,7 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
             address_cnt = address_cnt2 & 0xfffff; // 11
             b15 = b6 && (b15 ^ address_cmp); // 11
 
-            int samp1 = (int8_t)PCM_ReadROM(pcm, (hiaddr << 20) | address_cnt); // 20
+            int samp1 = (int8_t)PCM_ReadROM<family>(pcm, (hiaddr << 20) | address_cnt); // 20
 
             cmp1 = address;
             cmp2 = address_cnt;
@@ -1223,7 +1249,7 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
             address_cnt = address_cnt2 & 0xfffff; // 15
             b15 = b6 && (b15 ^ address_cmp); // 15
 
-            int samp2 = (int8_t)PCM_ReadROM(pcm, (hiaddr << 20) | address_cnt); // 1
+            int samp2 = (int8_t)PCM_ReadROM<family>(pcm, (hiaddr << 20) | address_cnt); // 1
 
             cmp1 = address;
             cmp2 = address_cnt;
@@ -1252,7 +1278,7 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
             address_cnt = address_cnt2 & 0xfffff; // 19
             b15 = b6 && (b15 ^ address_cmp); // 19
 
-            int samp3 = (int8_t)PCM_ReadROM(pcm, (hiaddr << 20) | address_cnt); // 5
+            int samp3 = (int8_t)PCM_ReadROM<family>(pcm, (hiaddr << 20) | address_cnt); // 5
 
             cmp1 = address;
             cmp2 = address_cnt;
@@ -1376,7 +1402,7 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
             int filter = ram2[11];
             int v3;
 
-            if (pcm.mcu->is_mk1)
+            if constexpr (is_mk1)
             {
                 int mult1 = multi(reg1, filter >> 8); // 8
                 int mult2 = multi(reg1, (filter >> 1) & 127); // 9
@@ -1434,7 +1460,7 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
                     ram2[8] |= 0x4000;
                 pcm.irq_assert = 1;
                 pcm.irq_channel = slot;
-                if (pcm.mcu->is_jv880)
+                if constexpr (is_jv880)
                     MCU_GA_SetGAInt(*pcm.mcu, 5, 1);
                 else
                     MCU_Interrupt_SetRequest(*pcm.mcu, INTERRUPT_SOURCE_IRQ0, 1);
@@ -1570,10 +1596,67 @@ void PCM_Update(pcm_t& pcm, uint64_t cycles)
 
         int new_cycles = (pcm.config.reg_slots + 1) * 25;
 
-        pcm.cycles += pcm.mcu->is_jv880 ? (new_cycles * 25) / 29 : new_cycles;
+        pcm.cycles += is_jv880 ? (new_cycles * 25) / 29 : new_cycles;
+    }
+}
+
+template void PCM_Update<RomsetFamily::MK2>(pcm_t& pcm, uint64_t cycles);
+template void PCM_Update<RomsetFamily::MK1>(pcm_t& pcm, uint64_t cycles);
+template void PCM_Update<RomsetFamily::JV880>(pcm_t& pcm, uint64_t cycles);
+template void PCM_Update<RomsetFamily::SCB55>(pcm_t& pcm, uint64_t cycles);
+
+void PCM_Update(pcm_t& pcm, uint64_t cycles)
+{
+    switch (pcm.mcu->family)
+    {
+    case RomsetFamily::MK1:
+        PCM_Update<RomsetFamily::MK1>(pcm, cycles);
+        break;
+    case RomsetFamily::JV880:
+        PCM_Update<RomsetFamily::JV880>(pcm, cycles);
+        break;
+    case RomsetFamily::SCB55:
+        PCM_Update<RomsetFamily::SCB55>(pcm, cycles);
+        break;
+    default:
+        PCM_Update<RomsetFamily::MK2>(pcm, cycles);
+        break;
     }
 }
 
+uint64_t PCM_NextEvent(const pcm_t& pcm)
+{
+    return pcm.cycles + 1;
+}
+
+uint32_t PCM_GetActiveVoices(const pcm_t& pcm)
+{
+    return pcm.voice_mask & pcm.voice_mask_pending;
+}
+
+int PCM_GetEffectPeak(const pcm_t& pcm)
+{
+    int peak = 0;
+    for (int addr = 0; addr < (int)std::size(pcm.eram); addr++)
+    {
+        peak = std::max(peak, std::abs(eram_unpack(pcm, addr)));
+    }
+    return peak;
+}
+
+double PCM_GetResidualLevel(const pcm_t& pcm)
+{
+    double effect_sum = 0.0;
+    for (int addr = 0; addr < (int)std::size(pcm.eram); addr++)
+    {
+        const int val = eram_unpack(pcm, addr);
+        effect_sum += (double)val * val;
+    }
+    const double accum_sum = (double)pcm.accum_l * pcm.accum_l + (double)pcm.accum_r * pcm.accum_r;
+
+    return std::sqrt(std::max(effect_sum / std::size(pcm.eram), accum_sum / 2));
+}
+
 uint32_t PCM_GetOutputFrequency(const pcm_t& pcm)
 {
     uint32_t freq = (pcm.mcu->is_mk1 || pcm.mcu->is_jv880) ? 64000 : 66207;
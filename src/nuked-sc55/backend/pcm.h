@@ -34,6 +34,7 @@
 
 #pragma once
 
+#include "rom.h"
 #include <cstdint>
 
 struct mcu_t;
@@ -76,26 +77,47 @@ struct pcm_t {
 
     uint64_t cycles = 0;
 
-    uint16_t eram[0x4000]{};
-
     int accum_l = 0;
     int accum_r = 0;
     int rcsum[2]{};
 
     mcu_t* mcu = nullptr;
 
-    uint8_t waverom1[0x200000]{};
-    uint8_t waverom2[0x200000]{};
-    uint8_t waverom3[0x100000]{};
-    uint8_t waverom_card[0x200000]{};
-    uint8_t waverom_exp[0x800000]{};
+    // Read-only, possibly shared with other instances. Each points to GetRomCapacity() bytes for its location.
+    const uint8_t* waverom1 = nullptr;
+    const uint8_t* waverom2 = nullptr;
+    const uint8_t* waverom3 = nullptr;
+    const uint8_t* waverom_card = nullptr;
+    const uint8_t* waverom_exp = nullptr;
 
     bool disable_oversampling = false;
+
+    // Effect RAM. Kept last so that it doesn't separate the fields above, which PCM_Update touches on every sample.
+    uint16_t eram[0x4000]{};
 };
 
+// The MCU and the PCM run in lockstep and can't be pipelined on separate threads. PCM_Update's result for a sample
+// depends on every PCM_Write before it. The MCU's next instruction depends on that result: PCM_Update may raise IRQ0
+// (GA interrupt 5 on the JV-880), and through the read latch PCM_Read exposes any slot's ram1/ram2 words, which
+// PCM_Update rewrites on every sample, including the reverb and chorus slots. Letting the MCU run ahead would mean
+// checkpointing and rolling back the whole MCU, sub-MCU and timer state whenever a sample raises an interrupt or the
+// firmware reads the PCM.
 void PCM_Write(pcm_t& pcm, uint32_t address, uint8_t data);
 uint8_t PCM_Read(pcm_t& pcm, uint32_t address);
 void PCM_Init(pcm_t& pcm, mcu_t& mcu);
 void PCM_Update(pcm_t& pcm, uint64_t cycles);
+// PCM_Update specialised for one romset family. The family must match pcm.mcu->family.
+template <RomsetFamily family>
+void PCM_Update(pcm_t& pcm, uint64_t cycles);
+// Earliest MCU cycle count at which PCM_Update has work to do.
+uint64_t PCM_NextEvent(const pcm_t& pcm);
 uint32_t PCM_GetOutputFrequency(const pcm_t& pcm);
+// Slots that PCM_Update is currently playing, one bit per slot.
+uint32_t PCM_GetActiveVoices(const pcm_t& pcm);
+// Largest magnitude held in the effect RAM, on the 20-bit scale of the accumulators. Drops to (nearly) zero once
+// the reverb and chorus have died out.
+int PCM_GetEffectPeak(const pcm_t& pcm);
+// RMS level of what's left once every voice has stopped: the larger of the mixing accumulators' level and the effect
+// RAM's, on the same scale as PCM_GetEffectPeak.
+double PCM_GetResidualLevel(const pcm_t& pcm);
 void PCM_GetConfig(PCM_Config& config, uint8_t config_byte);
@@ -34,8 +34,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <span>
 
@@ -215,6 +219,36 @@ public:
         m_read_head = Mask2(m_read_head + count * sizeof(ElemT));
     }
 
+    // Unlike UncheckedPrepareRead/Write, these accept any count. The returned span holds every readable (writable)
+    // element up to the end of the buffer; once it has been used, the next call returns the ones that wrap around.
+    template <typename ElemT>
+    std::span<ElemT> PrepareContiguousRead()
+    {
+        const size_t contiguous = std::min(GetReadableBytes(), m_buffer.size() - Mask(m_read_head));
+        return {(ElemT*)GetReadPtr(), contiguous / sizeof(ElemT)};
+    }
+
+    template <typename ElemT>
+    void FinishContiguousRead(size_t count)
+    {
+        assert(count <= GetReadableElements<ElemT>());
+        m_read_head = Mask2(m_read_head + count * sizeof(ElemT));
+    }
+
+    template <typename ElemT>
+    std::span<ElemT> PrepareContiguousWrite()
+    {
+        const size_t contiguous = std::min(GetWritableBytes(), m_buffer.size() - Mask(m_write_head));
+        return {(ElemT*)GetWritePtr(), contiguous / sizeof(ElemT)};
+    }
+
+    template <typename ElemT>
+    void FinishContiguousWrite(size_t count)
+    {
+        assert(count <= GetWritableElements<ElemT>());
+        m_write_head = Mask2(m_write_head + count * sizeof(ElemT));
+    }
+
     size_t GetReadableBytes() const
     {
         return Mask(m_write_head - m_read_head);
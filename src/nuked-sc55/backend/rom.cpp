@@ -47,6 +47,24 @@ std::span<const char*> GetParsableRomsetNames()
     return rs_name_simple;
 }
 
+RomsetFamily GetRomsetFamily(Romset romset)
+{
+    switch (romset)
+    {
+    case Romset::MK1:
+    case Romset::SC155:
+    case Romset::CM300:
+        return RomsetFamily::MK1;
+    case Romset::JV880:
+        return RomsetFamily::JV880;
+    case Romset::SCB55:
+    case Romset::RLP3237:
+        return RomsetFamily::SCB55;
+    default:
+        return RomsetFamily::MK2;
+    }
+}
+
 bool IsWaverom(RomLocation location)
 {
     switch (location)
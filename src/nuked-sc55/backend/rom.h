@@ -24,6 +24,18 @@ bool ParseRomsetName(std::string_view name, Romset& romset);
 
 std::span<const char*> GetParsableRomsetNames();
 
+// Groups of romsets that share the same hardware as far as the emulator's hot paths are concerned. MCU_Step,
+// PCM_Update and TIMER_Clock are compiled once per family.
+enum class RomsetFamily
+{
+    MK2,   // SC-55mk2, SC-55st, SC-155mk2: sub-MCU handles MIDI
+    MK1,   // SC-55, SC-155, CM-300/SCC-1
+    JV880,
+    SCB55, // SCB-55, RLP-3237: no sub-MCU
+};
+
+RomsetFamily GetRomsetFamily(Romset romset);
+
 // Symbolic name for the various roms used by the emulator.
 enum class RomLocation
 {
@@ -1,13 +1,24 @@
 #include "rom_io.h"
 #include "cast.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <random>
+#include <system_error>
+#include <thread>
 
 extern "C"
 {
 #include "sha/sha.h"
 }
 
-using SHA256Digest = std::array<uint8_t, SHA256HashSize>;
+using SHA256Digest = RomDigest;
+static_assert(std::tuple_size_v<SHA256Digest> == SHA256HashSize);
 
 const char* legacy_rom_names[(size_t)ROMSET_COUNT][ROMLOCATION_COUNT] = {
     // MK2
@@ -183,30 +194,99 @@ const char* legacy_rom_names[(size_t)ROMSET_COUNT][ROMLOCATION_COUNT] = {
     },
 };
 
-void unscramble(const uint8_t *src, uint8_t *dst, int len)
+// Waveroms are stored with address bits 0-19 and the data bits permuted. Bit `j` of an unscrambled address or byte
+// comes from bit `UNSCRAMBLE_ADDRESS_BITS[j]` or `UNSCRAMBLE_DATA_BITS[j]` of the scrambled one.
+static constexpr int UNSCRAMBLE_ADDRESS_BITS[] = {
+    2, 0, 3, 4, 1, 9, 13, 10, 18, 17, 6, 15, 11, 16, 8, 5, 12, 7, 14, 19
+};
+static constexpr int UNSCRAMBLE_DATA_BITS[] = {
+    2, 0, 4, 5, 7, 6, 3, 1
+};
+
+// The address permutation is split into two lookups on the low and high 10 bits, whose results are OR'd together.
+struct UnscrambleTables
 {
-    for (int i = 0; i < len; i++)
+    uint32_t address_lo[1024];
+    uint32_t address_hi[1024];
+    uint8_t  data[256];
+};
+
+static constexpr UnscrambleTables MakeUnscrambleTables()
+{
+    UnscrambleTables tables{};
+    for (uint32_t i = 0; i < 1024; i++)
     {
-        int address = i & ~0xfffff;
-        static const int aa[] = {
-            2, 0, 3, 4, 1, 9, 13, 10, 18, 17, 6, 15, 11, 16, 8, 5, 12, 7, 14, 19
-        };
-        for (int j = 0; j < 20; j++)
+        for (int j = 0; j < 10; j++)
         {
             if (i & (1 << j))
-                address |= 1<<aa[j];
+            {
+                tables.address_lo[i] |= 1 << UNSCRAMBLE_ADDRESS_BITS[j];
+                tables.address_hi[i] |= 1 << UNSCRAMBLE_ADDRESS_BITS[j + 10];
+            }
         }
-        uint8_t srcdata = src[address];
-        uint8_t data = 0;
-        static const int dd[] = {
-            2, 0, 4, 5, 7, 6, 3, 1
-        };
+    }
+    for (int i = 0; i < 256; i++)
+    {
         for (int j = 0; j < 8; j++)
         {
-            if (srcdata & (1 << dd[j]))
-                data |= 1<<j;
+            if (i & (1 << UNSCRAMBLE_DATA_BITS[j]))
+            {
+                tables.data[i] |= 1 << j;
+            }
+        }
+    }
+    return tables;
+}
+
+static constexpr UnscrambleTables UNSCRAMBLE_TABLES = MakeUnscrambleTables();
+
+static void UnscrambleRange(const uint8_t* src, uint8_t* dst, size_t begin, size_t end)
+{
+    const UnscrambleTables& t = UNSCRAMBLE_TABLES;
+    for (size_t i = begin; i < end; i++)
+    {
+        const size_t address = (i & ~(size_t)0xfffff) | t.address_hi[(i >> 10) & 0x3ff] | t.address_lo[i & 0x3ff];
+        dst[i] = t.data[src[address]];
+    }
+}
+
+void unscramble(const uint8_t *src, uint8_t *dst, int len)
+{
+    // Split into chunks handed out to a few threads. Writes are sequential within each chunk, reads are scattered
+    // across the whole bank either way.
+    static const size_t CHUNK_SIZE  = 0x10000;
+    static const size_t MAX_THREADS = 4;
+
+    const size_t size        = (size_t)len;
+    const size_t chunk_count = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    const size_t thread_count =
+        std::min({chunk_count, (size_t)std::max(std::thread::hardware_concurrency(), 1u), MAX_THREADS});
+
+    std::atomic<size_t> next_chunk = 0;
+    auto worker = [&]() {
+        for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++)
+        {
+            UnscrambleRange(src, dst, chunk * CHUNK_SIZE, std::min(size, (chunk + 1) * CHUNK_SIZE));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        try
+        {
+            threads.emplace_back(worker);
+        }
+        catch (const std::system_error&)
+        {
+            // the calling thread picks up the remaining chunks
+            break;
         }
-        dst[i] = data;
+    }
+    worker();
+    for (auto& thread : threads)
+    {
+        thread.join();
     }
 }
 
@@ -535,6 +615,119 @@ static constexpr KnownHash ROM_HASHES[] = {
 // clang-format on
 
 
+// Every rom in ROM_HASHES is a power-of-two sized chip dump, from the 4 KB sub-MCU rom to the 16 Mbit waveroms. Files
+// of any other size are never read.
+static bool IsPlausibleRomSize(uintmax_t size)
+{
+    return size >= 0x1000 && size <= 0x400000 && std::has_single_bit(size);
+}
+
+struct RomIndexEntry
+{
+    uintmax_t    size;
+    int64_t      mtime;
+    SHA256Digest digest;
+
+    bool operator==(const RomIndexEntry&) const = default;
+};
+
+// Maps file paths to the digest they had at the given size and modification time.
+using RomIndex = std::map<std::string, RomIndexEntry>;
+
+static const char ROM_INDEX_HEADER[] = "nuked-sc55 rom index 1";
+
+static std::string DigestToString(const SHA256Digest& digest)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (uint8_t byte : digest)
+    {
+        hex += digits[byte >> 4];
+        hex += digits[byte & 15];
+    }
+    return hex;
+}
+
+// One line per file: "<size> <mtime> <digest> <path>". Malformed lines are ignored, so a damaged index only costs a
+// rescan.
+static void LoadRomIndex(const std::filesystem::path& index_path, RomIndex& index)
+{
+    std::ifstream file(index_path);
+    std::string   line;
+    if (!std::getline(file, line) || line != ROM_INDEX_HEADER)
+    {
+        return;
+    }
+
+    while (std::getline(file, line))
+    {
+        RomIndexEntry entry;
+        char          hex[2 * SHA256HashSize + 1];
+        int           path_offset = 0;
+        if (sscanf(line.c_str(), "%ju %" SCNd64 " %64s %n", &entry.size, &entry.mtime, hex, &path_offset) != 3 ||
+            path_offset == 0 || strlen(hex) != 2 * SHA256HashSize)
+        {
+            continue;
+        }
+        bool valid = true;
+        for (size_t i = 0; i < 2 * SHA256HashSize; ++i)
+        {
+            valid = valid && ((hex[i] >= '0' && hex[i] <= '9') || (hex[i] >= 'a' && hex[i] <= 'f'));
+        }
+        if (valid)
+        {
+            for (size_t i = 0; i < SHA256HashSize; ++i)
+            {
+                entry.digest[i] = (uint8_t)((HexValue(hex[2 * i + 0]) << 4) | HexValue(hex[2 * i + 1]));
+            }
+            index.insert_or_assign(line.substr((size_t)path_offset), entry);
+        }
+    }
+}
+
+std::filesystem::path MakeTempPath(const std::filesystem::path& path)
+{
+    // The token tells processes apart, the counter tells apart calls within a process
+    static const uint64_t token = ((uint64_t)std::random_device{}() << 32) | std::random_device{}();
+    static std::atomic<uint64_t> counter = 0;
+
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".%016" PRIx64 "-%" PRIu64 ".tmp", token, counter.fetch_add(1));
+
+    std::filesystem::path tmp_path = path;
+    tmp_path += suffix;
+    return tmp_path;
+}
+
+// Written to a temporary file first so that concurrent scans never read a partial index.
+static void SaveRomIndex(const std::filesystem::path& index_path, const RomIndex& index)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(index_path.parent_path(), ec);
+
+    const std::filesystem::path tmp_path = MakeTempPath(index_path);
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        file << ROM_INDEX_HEADER << '\n';
+        for (const auto& [path, entry] : index)
+        {
+            file << entry.size << ' ' << entry.mtime << ' ' << DigestToString(entry.digest) << ' ' << path << '\n';
+        }
+        if (!file)
+        {
+            file.close();
+            std::filesystem::remove(tmp_path, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmp_path, index_path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmp_path, ec);
+    }
+}
+
 bool DetectRomsetsByHash(const std::filesystem::path& base_path,
                              AllRomsetInfo&           all_info,
                              RomLocationSet*          desired)
@@ -549,6 +742,13 @@ bool DetectRomsetsByHash(const std::filesystem::path& base_path,
         return false;
     }
 
+    RomIndex old_index;
+    RomIndex new_index;
+    if (!all_info.rom_index_path.empty())
+    {
+        LoadRomIndex(all_info.rom_index_path, old_index);
+    }
+
     std::vector<uint8_t> buffer;
 
     while (dir_iter != std::filesystem::directory_iterator{})
@@ -584,8 +784,8 @@ bool DetectRomsetsByHash(const std::filesystem::path& base_path,
             return false;
         }
 
-        // Skip files larger than 4MB
-        if (file_size > (uintmax_t)(4 * 1024 * 1024))
+        // Skip files that can't be any known rom
+        if (!IsPlausibleRomSize(file_size))
         {
             dir_iter.increment(ec);
             if (ec)
@@ -596,33 +796,84 @@ bool DetectRomsetsByHash(const std::filesystem::path& base_path,
             continue;
         }
 
-        ReadAllBytes(dir_iter->path(), buffer);
+        // Reuse the digest from the index if the file looks unchanged
+        const std::string index_key = dir_iter->path().generic_string();
+        const auto        file_time = dir_iter->last_write_time(ec);
+        const int64_t     mtime     = ec ? 0 : (int64_t)file_time.time_since_epoch().count();
 
-        SHA256Context ctx;
-        SHA256Digest  digest_bytes;
+        SHA256Digest digest_bytes;
+        bool         have_buffer = false;
 
-        SHA256Reset(&ctx);
-        SHA256Input(&ctx, buffer.data(), buffer.size());
-        SHA256Result(&ctx, digest_bytes.data());
+        const auto cached = old_index.find(index_key);
+        if (!ec && cached != old_index.end() && cached->second.size == file_size && cached->second.mtime == mtime)
+        {
+            digest_bytes = cached->second.digest;
+        }
+        else if (ReadAllBytes(dir_iter->path(), buffer))
+        {
+            have_buffer = true;
+
+            SHA256Context ctx;
+            SHA256Reset(&ctx);
+            SHA256Input(&ctx, buffer.data(), buffer.size());
+            SHA256Result(&ctx, digest_bytes.data());
+        }
+        else
+        {
+            dir_iter.increment(ec);
+            if (ec)
+            {
+                fprintf(stderr, "Failed to get next file: %s\n", ec.message().c_str());
+                return false;
+            }
+            continue;
+        }
+
+        if (mtime != 0)
+        {
+            new_index.insert_or_assign(index_key, RomIndexEntry{file_size, mtime, digest_bytes});
+        }
 
         for (const auto& known : ROM_HASHES)
         {
             if (known.hash == digest_bytes && !all_info.romsets[(size_t)known.romset].HasRom(known.location))
             {
-                all_info.romsets[(size_t)known.romset].rom_paths[(size_t)known.location] = dir_iter->path();
+                all_info.romsets[(size_t)known.romset].rom_paths[(size_t)known.location]   = dir_iter->path();
+                all_info.romsets[(size_t)known.romset].rom_digests[(size_t)known.location] = digest_bytes;
 
                 if (desired && (*desired)[(size_t)known.location])
                 {
+                    if (!IsWaverom(known.location))
+                    {
+                        auto& rom_image = all_info.romsets[(size_t)known.romset].rom_images[(size_t)known.location];
+                        rom_image       = MapRomImage(known.location, dir_iter->path());
+                        if (rom_image)
+                        {
+                            continue;
+                        }
+                    }
+
+                    if (!have_buffer)
+                    {
+                        if (!ReadAllBytes(dir_iter->path(), buffer))
+                        {
+                            // leave rom_data empty; LoadRomset will try the path again
+                            continue;
+                        }
+                        have_buffer = true;
+                    }
+
                     auto& rom_data = all_info.romsets[(size_t)known.romset].rom_data[(size_t)known.location];
                     if (IsWaverom(known.location))
                     {
                         rom_data.resize(buffer.size());
-                        unscramble(rom_data.data(), buffer.data(), (int)buffer.size());
+                        unscramble(buffer.data(), rom_data.data(), (int)buffer.size());
                     }
                     else
                     {
-                        rom_data = std::move(buffer);
-                        buffer   = {};
+                        rom_data    = std::move(buffer);
+                        buffer      = {};
+                        have_buffer = false;
                     }
                 }
             }
@@ -636,6 +887,12 @@ bool DetectRomsetsByHash(const std::filesystem::path& base_path,
         }
     }
 
+    // Only entries for files that still exist are kept
+    if (!all_info.rom_index_path.empty() && new_index != old_index)
+    {
+        SaveRomIndex(all_info.rom_index_path, new_index);
+    }
+
     return true;
 }
 
@@ -756,11 +1013,16 @@ void RomsetInfo::PurgeRomData()
     {
         vec = {};
     }
+    for (auto& image : rom_images)
+    {
+        image.reset();
+    }
 }
 
 bool RomsetInfo::HasRom(RomLocation location) const
 {
-    return !(rom_paths[(size_t)location].empty() && rom_data[(size_t)location].empty());
+    return !(rom_paths[(size_t)location].empty() && rom_data[(size_t)location].empty() &&
+             !rom_images[(size_t)location]);
 }
 
 void AllRomsetInfo::PurgeRomData()
@@ -771,11 +1033,94 @@ void AllRomsetInfo::PurgeRomData()
     }
 }
 
+// Cached images are named after the SHA-256 of the scrambled rom, so a changed rom never picks up a stale image. The
+// digest is only computed if `digest` doesn't already hold it, and is stored there for later users.
+static std::filesystem::path GetWaveromCachePath(const std::filesystem::path& cache_dir,
+                                                 std::span<const uint8_t>     scrambled,
+                                                 std::optional<RomDigest>&    digest)
+{
+    if (!digest)
+    {
+        SHA256Context ctx;
+        SHA256Digest  digest_bytes;
+
+        SHA256Reset(&ctx);
+        SHA256Input(&ctx, scrambled.data(), (unsigned int)scrambled.size());
+        SHA256Result(&ctx, digest_bytes.data());
+
+        digest = digest_bytes;
+    }
+
+    std::string name;
+    for (uint8_t byte : *digest)
+    {
+        static const char digits[] = "0123456789abcdef";
+        name += digits[byte >> 4];
+        name += digits[byte & 15];
+    }
+    name += ".unscrambled";
+
+    return cache_dir / name;
+}
+
+// Loads the unscrambled `scrambled` waverom into `info.rom_images` by mapping it from `cache_dir`, creating the cached
+// copy first if necessary. If the cache can't be read or written, the waverom is unscrambled into `info.rom_data`
+// instead.
+static void LoadCachedWaverom(RomsetInfo&                  info,
+                              RomLocation                  location,
+                              std::span<const uint8_t>     scrambled,
+                              const std::filesystem::path& cache_dir)
+{
+    const std::filesystem::path path = GetWaveromCachePath(cache_dir, scrambled, info.rom_digests[(size_t)location]);
+
+    std::shared_ptr<const RomImage> image = MapRomImage(location, path);
+    if (image && image->size == scrambled.size())
+    {
+        info.rom_images[(size_t)location] = std::move(image);
+        return;
+    }
+
+    std::vector<uint8_t>& unscrambled = info.rom_data[(size_t)location];
+    unscrambled.resize(scrambled.size());
+    unscramble(scrambled.data(), unscrambled.data(), (int)scrambled.size());
+
+    // Write to a temporary file first so concurrent loaders never map a partial image.
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir, ec);
+
+    const std::filesystem::path tmp_path = MakeTempPath(path);
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write((const char*)unscrambled.data(), RangeCast<std::streamsize>(unscrambled.size()));
+        if (!file)
+        {
+            file.close();
+            std::filesystem::remove(tmp_path, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmp_path, ec);
+        return;
+    }
+
+    // Prefer the mapping: its pages are shared with other processes and can be dropped under memory pressure.
+    image = MapRomImage(location, path);
+    if (image && image->size == scrambled.size())
+    {
+        info.rom_images[(size_t)location] = std::move(image);
+        unscrambled = {};
+    }
+}
+
 bool LoadRomset(Romset romset, AllRomsetInfo& all_info, RomLoadStatusSet* loaded)
 {
     bool all_loaded = true;
 
-    // We cannot unscramble in-place.
+    // Only used if a file can't be mapped. We cannot unscramble in-place.
     std::vector<uint8_t> on_demand_buffer;
 
     RomsetInfo& info = all_info.romsets[(size_t)romset];
@@ -784,7 +1129,9 @@ bool LoadRomset(Romset romset, AllRomsetInfo& all_info, RomLoadStatusSet* loaded
     {
         const RomLocation location = (RomLocation)i;
 
-        if (info.rom_paths[i].empty() && info.rom_data[i].empty())
+        const bool has_data = !info.rom_data[i].empty() || info.rom_images[i];
+
+        if (info.rom_paths[i].empty() && !has_data)
         {
             if (loaded)
             {
@@ -792,9 +1139,21 @@ bool LoadRomset(Romset romset, AllRomsetInfo& all_info, RomLoadStatusSet* loaded
             }
             continue;
         }
-        else if (!info.rom_paths[i].empty() && info.rom_data[i].empty())
+        else if (!info.rom_paths[i].empty() && !has_data)
         {
-            if (!ReadAllBytes(info.rom_paths[i], on_demand_buffer))
+            // Program roms are handed to the emulator as the mapping itself; waverom mappings are only read from to
+            // unscramble them.
+            std::shared_ptr<const RomImage> file = MapRomImage(location, info.rom_paths[i]);
+            std::span<const uint8_t>        contents;
+            if (file)
+            {
+                contents = {file->data, file->size};
+            }
+            else if (ReadAllBytes(info.rom_paths[i], on_demand_buffer))
+            {
+                contents = on_demand_buffer;
+            }
+            else
             {
                 all_loaded = false;
                 if (loaded)
@@ -804,10 +1163,18 @@ bool LoadRomset(Romset romset, AllRomsetInfo& all_info, RomLoadStatusSet* loaded
                 continue;
             }
 
-            if (IsWaverom(location))
+            if (IsWaverom(location) && !all_info.waverom_cache_dir.empty())
+            {
+                LoadCachedWaverom(info, location, contents, all_info.waverom_cache_dir);
+            }
+            else if (IsWaverom(location))
+            {
+                info.rom_data[i].resize(contents.size());
+                unscramble(contents.data(), info.rom_data[i].data(), (int)contents.size());
+            }
+            else if (file)
             {
-                info.rom_data[i].resize(on_demand_buffer.size());
-                unscramble(on_demand_buffer.data(), info.rom_data[i].data(), (int)on_demand_buffer.size());
+                info.rom_images[i] = std::move(file);
             }
             else
             {
@@ -820,7 +1187,7 @@ bool LoadRomset(Romset romset, AllRomsetInfo& all_info, RomLoadStatusSet* loaded
                 (*loaded)[i] = RomLoadStatus::Loaded;
             }
         }
-        else if (!info.rom_data[i].empty())
+        else if (has_data)
         {
             if (loaded)
             {
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "rom.h"
+#include "rom_store.h"
+#include <array>
 #include <filesystem>
+#include <optional>
 #include <vector>
 
 enum class RomLoadStatus
@@ -34,6 +37,9 @@ const char* ToCString(RomCompletionStatus status);
 // Set of completion statuses. Indexed by RomLocation.
 using RomCompletionStatusSet = std::array<RomCompletionStatus, ROMLOCATION_COUNT>;
 
+// SHA-256 digest of a rom file as it is stored on disk, i.e. before waveroms are unscrambled.
+using RomDigest = std::array<uint8_t, 32>;
+
 // For a single romset, this structure maps each rom in the set to a filename on disk and that file's contents.
 struct RomsetInfo
 {
@@ -41,10 +47,18 @@ struct RomsetInfo
     std::filesystem::path rom_paths[ROMLOCATION_COUNT]{};
     std::vector<uint8_t>  rom_data[ROMLOCATION_COUNT]{};
 
-    // Release all rom_data for all roms in this romset.
+    // Array indexed by RomLocation. Roms that are already available as an image, e.g. waveroms mapped from the
+    // unscrambled cache. The emulator uses these without copying them. Takes precedence over `rom_data`.
+    std::shared_ptr<const RomImage> rom_images[ROMLOCATION_COUNT]{};
+
+    // Array indexed by RomLocation. Digest of the file at `rom_paths`, if it is already known, e.g. because
+    // `DetectRomsetsByHash` matched it. Not affected by `PurgeRomData`.
+    std::optional<RomDigest> rom_digests[ROMLOCATION_COUNT]{};
+
+    // Release all rom_data and rom_images for all roms in this romset.
     void PurgeRomData();
 
-    // Returns true if at least one of `rom_path` or `rom_data` is populated for `location`.
+    // Returns true if at least one of `rom_path`, `rom_data` or `rom_images` is populated for `location`.
     bool HasRom(RomLocation location) const;
 };
 
@@ -54,7 +68,15 @@ struct AllRomsetInfo
     // Array indexed by Romset
     RomsetInfo romsets[ROMSET_COUNT]{};
 
-    // Release all rom_data for all romsets.
+    // If not empty, `LoadRomset` keeps unscrambled copies of waveroms in this directory and maps them from there on
+    // later loads instead of unscrambling them again.
+    std::filesystem::path waverom_cache_dir;
+
+    // If not empty, `DetectRomsetsByHash` remembers the digest of every file it hashes in this file, and skips hashing
+    // files whose size and modification time haven't changed since.
+    std::filesystem::path rom_index_path;
+
+    // Release all rom_data and rom_images for all romsets.
     void PurgeRomData();
 };
 
@@ -68,13 +90,14 @@ bool DetectRomsetsByFilename(const std::filesystem::path& base_path,
                              RomLocationSet*              desired = nullptr);
 
 // Scans files in `base_path` for roms by hashing them. The locations of each rom will be made available in `info`. This
-// will return *all* romsets in `base_path`.
+// will return *all* romsets in `base_path`. Files whose size doesn't match any known rom are skipped without being read,
+// and digests are reused from `all_info.rom_index_path` if set.
 //
 // If any of the rom locations in `all_info` are already populated with a path or data, this function will not overwrite
 // them.
 //
 // If `desired` is non-null, this function will use it as a hint to determine what hashes to consider. This function may
-// also load `rom_data` for desired roms.
+// also load `rom_data` or `rom_images` for desired roms.
 bool DetectRomsetsByHash(const std::filesystem::path& base_path,
                          AllRomsetInfo&               all_info,
                          RomLocationSet*              desired = nullptr);
@@ -89,12 +112,26 @@ size_t CountPresent(const RomCompletionStatusSet& status);
 // returned is unspecified. Returns true if successful, or false if there are no complete romsets.
 bool PickCompleteRomset(const AllRomsetInfo& all_info, Romset& out_romset);
 
-// For each `rom` in `romset`, this function loads the file referenced by `all_info.romsets[romset].rom_paths[rom]` into
-// the corresponding `rom_data`. Waveroms will be unscrambled at this point.
+// Unscrambles the waverom contents `src` into `dst`, which must not overlap. `len` must be a multiple of 1 MB, the size
+// of a waverom bank.
+void unscramble(const uint8_t* src, uint8_t* dst, int len);
+
+// For each `rom` in `romset`, this function loads the file referenced by `all_info.romsets[romset].rom_paths[rom]`.
+// Program roms are mapped into `rom_images` (see MapRomImage), so the files must not be modified while they are in use;
+// they are read into `rom_data` only if mapping fails. Waveroms will be unscrambled into `rom_data` at this point. If
+// `all_info.waverom_cache_dir` is set, waveroms are instead loaded into `rom_images` through the cache, falling back to
+// `rom_data` when the cache can't be written.
 //
-// `rom` will only be loaded when `rom_data` is empty and `rom_path` is non-empty.
+// Once the roms are passed to `Emulator::LoadRoms`, `all_info.PurgeRomData()` may be called; the emulator keeps the
+// images it uses alive.
+//
+// `rom` will only be loaded when `rom_data` and `rom_images` are empty and `rom_path` is non-empty.
 //
 // To automatically determine rom_paths, call `DetectRomsetsByHash` with a directory containing roms.
 //
 // Roms that were loaded successfully will be marked as true in `loaded`.
 bool LoadRomset(Romset romset, AllRomsetInfo& all_info, RomLoadStatusSet* loaded = nullptr);
+
+// Returns a path next to `path` for writing a file that is then renamed over `path`, so that readers never see a
+// partial file. The name is unique to the call, so concurrent writers in this or other processes don't share it.
+std::filesystem::path MakeTempPath(const std::filesystem::path& path);
@@ -0,0 +1,187 @@
+#include "rom_store.h"
+
+#include "mcu.h"
+#include "pages.h"
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ROM_HAVE_MMAP
+#else
+#include <fstream>
+#endif
+
+static const size_t ROM_MAX_CAPACITY = 0x800000;
+
+// Zero-initialized, so it is backed by the kernel's shared zero page until something writes to it (nothing does).
+static uint8_t rom_empty[ROM_MAX_CAPACITY];
+
+static std::mutex                           rom_images_mutex;
+static std::vector<std::weak_ptr<RomImage>> rom_images;
+
+RomImage::~RomImage()
+{
+#ifdef ROM_HAVE_MMAP
+    if (mapped)
+    {
+        munmap((void*)data, GetRomCapacity(location));
+        return;
+    }
+#endif
+    FreePages((void*)data, GetRomCapacity(location), huge_pages);
+}
+
+size_t GetRomCapacity(RomLocation location)
+{
+    switch (location)
+    {
+    case RomLocation::ROM1:
+        return ROM1_SIZE;
+    case RomLocation::ROM2:
+        return ROM2_SIZE;
+    case RomLocation::WAVEROM1:
+        return 0x200000;
+    case RomLocation::WAVEROM2:
+        return 0x200000;
+    case RomLocation::WAVEROM3:
+        return 0x100000;
+    case RomLocation::WAVEROM_CARD:
+        return 0x200000;
+    case RomLocation::WAVEROM_EXP:
+        return ROM_MAX_CAPACITY;
+    case RomLocation::SMROM:
+        return ROMSM_SIZE;
+    }
+    return 0;
+}
+
+std::shared_ptr<const RomImage> AcquireRomImage(RomLocation location, std::span<const uint8_t> contents,
+                                                bool huge_pages)
+{
+    const size_t capacity = GetRomCapacity(location);
+    if (contents.size() > capacity)
+    {
+        return nullptr;
+    }
+
+    std::scoped_lock lock(rom_images_mutex);
+
+    // Only a handful of images are ever alive at once, so a linear scan is fine. Comparing contents directly is
+    // cheaper than hashing them and can't be fooled by collisions.
+    for (size_t i = 0; i < rom_images.size();)
+    {
+        std::shared_ptr<RomImage> image = rom_images[i].lock();
+        if (!image)
+        {
+            rom_images[i] = std::move(rom_images.back());
+            rom_images.pop_back();
+            continue;
+        }
+        if (image->location == location && image->size == contents.size() &&
+            memcmp(image->data, contents.data(), contents.size()) == 0)
+        {
+            return image;
+        }
+        ++i;
+    }
+
+    auto image      = std::make_shared<RomImage>();
+    image->location = location;
+    image->size     = contents.size();
+
+    // memory beyond the rom contents is left untouched and stays unbacked
+    uint8_t* data = (uint8_t*)AllocatePages(capacity, huge_pages);
+    if (!data)
+    {
+        return nullptr;
+    }
+    image->huge_pages = huge_pages;
+    if (!contents.empty())
+    {
+        memcpy(data, contents.data(), contents.size());
+    }
+    image->data = data;
+
+    rom_images.push_back(image);
+    return image;
+}
+
+std::shared_ptr<const RomImage> MapRomImage(RomLocation location, const std::filesystem::path& path)
+{
+#ifdef ROM_HAVE_MMAP
+    const size_t capacity = GetRomCapacity(location);
+
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uintmax_t)st.st_size > capacity)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // Reserve the whole capacity as anonymous zero pages, then map the file over the start of it, so reads past the
+    // end of the file see zeroes like they do for heap images.
+    void* base = mmap(nullptr, capacity, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return nullptr;
+    }
+    if (mmap(base, (size_t)st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(base, capacity);
+        close(fd);
+        return nullptr;
+    }
+    close(fd);
+
+    std::shared_ptr<RomImage> image;
+    try
+    {
+        image = std::make_shared<RomImage>();
+    }
+    catch (const std::bad_alloc&)
+    {
+        munmap(base, capacity);
+        return nullptr;
+    }
+    image->location = location;
+    image->data     = (const uint8_t*)base;
+    image->size     = (size_t)st.st_size;
+    image->mapped   = true;
+    return image;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return nullptr;
+    }
+    const std::streamoff size = file.tellg();
+    if (size <= 0 || (uintmax_t)size > GetRomCapacity(location))
+    {
+        return nullptr;
+    }
+    std::vector<uint8_t> contents((size_t)size);
+    file.seekg(0);
+    if (!file.read((char*)contents.data(), size))
+    {
+        return nullptr;
+    }
+    return AcquireRomImage(location, contents);
+#endif
+}
+
+const uint8_t* GetEmptyRom()
+{
+    return rom_empty;
+}
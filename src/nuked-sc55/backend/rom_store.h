@@ -0,0 +1,56 @@
+#pragma once
+
+#include "rom.h"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+// Read-only copy of a rom as the emulator addresses it. Emulator instances that load identical contents into the same
+// location share one image, so running several instances of a romset only keeps one copy of its waveroms in memory.
+struct RomImage
+{
+    RomImage() = default;
+    ~RomImage();
+
+    RomImage(const RomImage&)            = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    RomLocation location{};
+
+    // Points to `GetRomCapacity(location)` bytes. Bytes after the first `size` are zero; they are never written, so
+    // they don't take up any physical memory.
+    const uint8_t* data = nullptr;
+    size_t         size = 0;
+
+    // True if `data` is a read-only mapping of a file rather than a heap copy.
+    bool mapped = false;
+
+    // True if `data` was allocated with AllocatePages(..., true).
+    bool huge_pages = false;
+};
+
+// Returns the number of bytes the emulator can address at `location`. Roms larger than this cannot be loaded.
+size_t GetRomCapacity(RomLocation location);
+
+// Returns an image of `contents` loaded at `location`. If another live image has the same location and contents, that
+// image is returned instead of a new one. Images are released when the last reference to them is dropped.
+//
+// New images are backed by huge pages if `huge_pages` is true; see AllocatePages. An existing image is returned as is.
+//
+// Returns null if `contents` is too large for `location` or memory could not be allocated. Thread-safe.
+std::shared_ptr<const RomImage> AcquireRomImage(RomLocation location, std::span<const uint8_t> contents,
+                                                bool huge_pages = false);
+
+// Maps the file at `path` read-only as an image for `location`, without copying it. Pages are loaded on demand and
+// shared with every other process mapping the same file. Unlike AcquireRomImage, the result is never shared with other
+// images in this process.
+//
+// On platforms without mmap the file is read into a heap image instead, as if by AcquireRomImage.
+//
+// Returns null if the file can't be read or is empty or too large for `location`.
+std::shared_ptr<const RomImage> MapRomImage(RomLocation location, const std::filesystem::path& path);
+
+// Returns a zero-filled buffer at least as large as the capacity of any rom location. Used in place of roms that are
+// not loaded.
+const uint8_t* GetEmptyRom();
@@ -22,4 +22,22 @@
 
 #define SHA_Parity(x, y, z)  ((x) ^ (y) ^ (z))
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Processes `count` consecutive 512-bit blocks into the SHA-256
+ * intermediate hash `state`, using the fastest implementation the
+ * CPU supports. Defined in sha256-compress.c.
+ */
+void SHA256_Compress(uint32_t state[8], const uint8_t *blocks,
+    size_t count);
+
+/*
+ * Switches SHA256_Compress between the portable implementation and
+ * the CPU-specific one, for testing. Returns nonzero if there is a
+ * CPU-specific one.
+ */
+int SHA256_UsePortableCompress(int portable);
+
 #endif /* _SHA_PRIVATE__H */
@@ -0,0 +1,393 @@
+/********************** sha256-compress.c **********************/
+/*
+ * Description:
+ *   This file implements the SHA-256 block compression function used
+ *   by sha224-256.c. Besides the portable version, there are versions
+ *   using the x86 SHA extensions and the ARMv8 Cryptography
+ *   Extensions. The fastest one supported by the running CPU is
+ *   picked the first time SHA256_Compress is called.
+ *
+ *   The hardware versions follow the structure of the public domain
+ *   SHA-Intrinsics code by Jeffrey Walton et al.
+ */
+
+#include "sha.h"
+#include "sha-private.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHA256_HAVE_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SHA256_X86_TARGET
+#else
+#include <cpuid.h>
+#define SHA256_X86_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+/*
+ * GCC and MSVC always declare the ARMv8 SHA-256 intrinsics; other
+ * compilers only do when the target has them, e.g. on Apple Silicon.
+ */
+#if (defined(__aarch64__) || defined(_M_ARM64)) &&                  \
+    ((defined(__GNUC__) && !defined(__clang__)) ||                  \
+     defined(_MSC_VER) || defined(__ARM_FEATURE_SHA2) ||            \
+     defined(__ARM_FEATURE_CRYPTO))
+#define SHA256_HAVE_ARM
+#include <arm_neon.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#define SHA256_ARM_TARGET __attribute__((target("+crypto")))
+#else
+#define SHA256_ARM_TARGET
+#endif
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+#endif
+
+/*
+ * MSVC only provides C11 atomics behind a flag, so its interlocked
+ * intrinsics are used there instead.
+ */
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <stdatomic.h>
+#endif
+
+/* Define the SHA shift, rotate left, and rotate right macros */
+#define SHA256_SHR(bits,word)      ((word) >> (bits))
+#define SHA256_ROTR(bits,word)                         \
+  (((word) >> (bits)) | ((word) << (32-(bits))))
+
+/* Define the SHA SIGMA and sigma macros */
+#define SHA256_SIGMA0(word)   \
+  (SHA256_ROTR( 2,word) ^ SHA256_ROTR(13,word) ^ SHA256_ROTR(22,word))
+#define SHA256_SIGMA1(word)   \
+  (SHA256_ROTR( 6,word) ^ SHA256_ROTR(11,word) ^ SHA256_ROTR(25,word))
+#define SHA256_sigma0(word)   \
+  (SHA256_ROTR( 7,word) ^ SHA256_ROTR(18,word) ^ SHA256_SHR( 3,word))
+#define SHA256_sigma1(word)   \
+  (SHA256_ROTR(17,word) ^ SHA256_ROTR(19,word) ^ SHA256_SHR(10,word))
+
+/* Constants defined in FIPS 180-3, section 4.2.2 */
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+    0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+    0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+    0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+    0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+    0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+    0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+    0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+    0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*
+ * One round of the compression function. Instead of shifting all
+ * eight working variables, the callers rotate the argument order.
+ */
+#define SHA256_ROUND(a,b,c,d,e,f,g,h,t)                            \
+  do {                                                             \
+    uint32_t temp1 = (h) + SHA256_SIGMA1(e) + SHA_Ch(e,f,g) +      \
+                     SHA256_K[t] + W[t];                           \
+    (d) += temp1;                                                  \
+    (h) = temp1 + SHA256_SIGMA0(a) + SHA_Maj(a,b,c);               \
+  } while (0)
+
+static void SHA256_CompressPortable(uint32_t state[8],
+    const uint8_t *blocks, size_t count)
+{
+  int        t;                       /* Loop counter */
+  uint32_t   W[64];                   /* Word sequence */
+  uint32_t   A, B, C, D, E, F, G, H;  /* Word buffers */
+
+  for (; count; count--, blocks += SHA256_Message_Block_Size) {
+    for (t = 0; t < 16; t++)
+      W[t] = (((uint32_t)blocks[4 * t]) << 24) |
+             (((uint32_t)blocks[4 * t + 1]) << 16) |
+             (((uint32_t)blocks[4 * t + 2]) << 8) |
+             (((uint32_t)blocks[4 * t + 3]));
+
+    for (t = 16; t < 64; t++)
+      W[t] = SHA256_sigma1(W[t-2]) + W[t-7] +
+          SHA256_sigma0(W[t-15]) + W[t-16];
+
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
+
+    for (t = 0; t < 64; t += 8) {
+      SHA256_ROUND(A, B, C, D, E, F, G, H, t + 0);
+      SHA256_ROUND(H, A, B, C, D, E, F, G, t + 1);
+      SHA256_ROUND(G, H, A, B, C, D, E, F, t + 2);
+      SHA256_ROUND(F, G, H, A, B, C, D, E, t + 3);
+      SHA256_ROUND(E, F, G, H, A, B, C, D, t + 4);
+      SHA256_ROUND(D, E, F, G, H, A, B, C, t + 5);
+      SHA256_ROUND(C, D, E, F, G, H, A, B, t + 6);
+      SHA256_ROUND(B, C, D, E, F, G, H, A, t + 7);
+    }
+
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
+  }
+}
+
+#ifdef SHA256_HAVE_X86
+/*
+ * Four rounds using message words M0, then (for all but the last
+ * four groups) computes the message words twelve rounds ahead into
+ * M0 from M0..M3.
+ */
+#define SHA256_X86_QUAD(i, M0, M1, M2, M3)                             \
+  do {                                                                 \
+    __m128i msg = _mm_add_epi32((M0),                                  \
+        _mm_loadu_si128((const __m128i *)&SHA256_K[4 * (i)]));         \
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, msg);               \
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1,                     \
+        _mm_shuffle_epi32(msg, 0x0E));                                 \
+    if ((i) < 12)                                                      \
+      (M0) = _mm_sha256msg2_epu32(_mm_add_epi32(                       \
+          _mm_sha256msg1_epu32((M0), (M1)),                            \
+          _mm_alignr_epi8((M3), (M2), 4)), (M3));                      \
+  } while (0)
+
+SHA256_X86_TARGET
+static void SHA256_CompressX86(uint32_t state[8],
+    const uint8_t *blocks, size_t count)
+{
+  const __m128i MASK =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i STATE0, STATE1, TMP, ABEF_SAVE, CDGH_SAVE;
+  __m128i M0, M1, M2, M3;
+
+  /* The SHA instructions keep the state as ABEF/CDGH */
+  TMP = _mm_loadu_si128((const __m128i *)&state[0]);
+  STATE1 = _mm_loadu_si128((const __m128i *)&state[4]);
+  TMP = _mm_shuffle_epi32(TMP, 0xB1);
+  STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);
+  STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+  STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+
+  for (; count; count--, blocks += SHA256_Message_Block_Size) {
+    ABEF_SAVE = STATE0;
+    CDGH_SAVE = STATE1;
+
+    M0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 0)), MASK);
+    M1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16)), MASK);
+    M2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 32)), MASK);
+    M3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 48)), MASK);
+
+    SHA256_X86_QUAD( 0, M0, M1, M2, M3);
+    SHA256_X86_QUAD( 1, M1, M2, M3, M0);
+    SHA256_X86_QUAD( 2, M2, M3, M0, M1);
+    SHA256_X86_QUAD( 3, M3, M0, M1, M2);
+    SHA256_X86_QUAD( 4, M0, M1, M2, M3);
+    SHA256_X86_QUAD( 5, M1, M2, M3, M0);
+    SHA256_X86_QUAD( 6, M2, M3, M0, M1);
+    SHA256_X86_QUAD( 7, M3, M0, M1, M2);
+    SHA256_X86_QUAD( 8, M0, M1, M2, M3);
+    SHA256_X86_QUAD( 9, M1, M2, M3, M0);
+    SHA256_X86_QUAD(10, M2, M3, M0, M1);
+    SHA256_X86_QUAD(11, M3, M0, M1, M2);
+    SHA256_X86_QUAD(12, M0, M1, M2, M3);
+    SHA256_X86_QUAD(13, M1, M2, M3, M0);
+    SHA256_X86_QUAD(14, M2, M3, M0, M1);
+    SHA256_X86_QUAD(15, M3, M0, M1, M2);
+
+    STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+    STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+  }
+
+  TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+  STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+  STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);
+  STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+  _mm_storeu_si128((__m128i *)&state[0], STATE0);
+  _mm_storeu_si128((__m128i *)&state[4], STATE1);
+}
+
+static int SHA256_HaveX86(void)
+{
+  /* SSSE3 and SSE4.1 in leaf 1 ECX, SHA in leaf 7 EBX */
+#if defined(_MSC_VER) && !defined(__clang__)
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7) return 0;
+  __cpuid(regs, 1);
+  if (!(regs[2] & (1 << 9)) || !(regs[2] & (1 << 19))) return 0;
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & (1 << 29)) != 0;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+  if (!(ecx & (1u << 9)) || !(ecx & (1u << 19))) return 0;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return 0;
+  return (ebx & (1u << 29)) != 0;
+#endif
+}
+#endif /* SHA256_HAVE_X86 */
+
+#ifdef SHA256_HAVE_ARM
+/* Same structure as SHA256_X86_QUAD */
+#define SHA256_ARM_QUAD(i, M0, M1, M2, M3)                             \
+  do {                                                                 \
+    uint32x4_t msg = vaddq_u32((M0), vld1q_u32(&SHA256_K[4 * (i)]));   \
+    uint32x4_t abcd = STATE0;                                          \
+    STATE0 = vsha256hq_u32(STATE0, STATE1, msg);                       \
+    STATE1 = vsha256h2q_u32(STATE1, abcd, msg);                        \
+    if ((i) < 12)                                                      \
+      (M0) = vsha256su1q_u32(vsha256su0q_u32((M0), (M1)), (M2), (M3)); \
+  } while (0)
+
+#define SHA256_ARM_LOAD(p) \
+  vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)))
+
+SHA256_ARM_TARGET
+static void SHA256_CompressARM(uint32_t state[8],
+    const uint8_t *blocks, size_t count)
+{
+  uint32x4_t STATE0, STATE1, ABCD_SAVE, EFGH_SAVE;
+  uint32x4_t M0, M1, M2, M3;
+
+  STATE0 = vld1q_u32(&state[0]);
+  STATE1 = vld1q_u32(&state[4]);
+
+  for (; count; count--, blocks += SHA256_Message_Block_Size) {
+    ABCD_SAVE = STATE0;
+    EFGH_SAVE = STATE1;
+
+    M0 = SHA256_ARM_LOAD(blocks + 0);
+    M1 = SHA256_ARM_LOAD(blocks + 16);
+    M2 = SHA256_ARM_LOAD(blocks + 32);
+    M3 = SHA256_ARM_LOAD(blocks + 48);
+
+    SHA256_ARM_QUAD( 0, M0, M1, M2, M3);
+    SHA256_ARM_QUAD( 1, M1, M2, M3, M0);
+    SHA256_ARM_QUAD( 2, M2, M3, M0, M1);
+    SHA256_ARM_QUAD( 3, M3, M0, M1, M2);
+    SHA256_ARM_QUAD( 4, M0, M1, M2, M3);
+    SHA256_ARM_QUAD( 5, M1, M2, M3, M0);
+    SHA256_ARM_QUAD( 6, M2, M3, M0, M1);
+    SHA256_ARM_QUAD( 7, M3, M0, M1, M2);
+    SHA256_ARM_QUAD( 8, M0, M1, M2, M3);
+    SHA256_ARM_QUAD( 9, M1, M2, M3, M0);
+    SHA256_ARM_QUAD(10, M2, M3, M0, M1);
+    SHA256_ARM_QUAD(11, M3, M0, M1, M2);
+    SHA256_ARM_QUAD(12, M0, M1, M2, M3);
+    SHA256_ARM_QUAD(13, M1, M2, M3, M0);
+    SHA256_ARM_QUAD(14, M2, M3, M0, M1);
+    SHA256_ARM_QUAD(15, M3, M0, M1, M2);
+
+    STATE0 = vaddq_u32(STATE0, ABCD_SAVE);
+    STATE1 = vaddq_u32(STATE1, EFGH_SAVE);
+  }
+
+  vst1q_u32(&state[0], STATE0);
+  vst1q_u32(&state[4], STATE1);
+}
+
+static int SHA256_HaveARM(void)
+{
+#if defined(__APPLE__)
+  return 1; /* every Apple Silicon CPU has them */
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+  return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#elif defined(_WIN32)
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) != 0;
+#elif defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+  return 1;
+#else
+  return 0;
+#endif
+}
+#endif /* SHA256_HAVE_ARM */
+
+typedef void (*SHA256CompressFunc)(uint32_t state[8],
+    const uint8_t *blocks, size_t count);
+
+/*
+ * Picked on first use. Every thread picks the same function, so
+ * racing initializations are harmless as long as the pointer itself
+ * is accessed atomically; no ordering is needed.
+ */
+#if defined(_MSC_VER) && !defined(__clang__)
+static void *volatile SHA256_CompressImpl;
+#define SHA256_LOAD_IMPL()                                          \
+  ((SHA256CompressFunc)_InterlockedCompareExchangePointer(          \
+      &SHA256_CompressImpl, NULL, NULL))
+#define SHA256_STORE_IMPL(impl)                                     \
+  ((void)_InterlockedExchangePointer(&SHA256_CompressImpl, (void *)(impl)))
+#else
+static _Atomic(SHA256CompressFunc) SHA256_CompressImpl;
+#define SHA256_LOAD_IMPL()                                          \
+  atomic_load_explicit(&SHA256_CompressImpl, memory_order_relaxed)
+#define SHA256_STORE_IMPL(impl)                                     \
+  atomic_store_explicit(&SHA256_CompressImpl, (impl), memory_order_relaxed)
+#endif
+
+static SHA256CompressFunc SHA256_SelectCompress(void)
+{
+#ifdef SHA256_HAVE_X86
+  if (SHA256_HaveX86()) return SHA256_CompressX86;
+#endif
+#ifdef SHA256_HAVE_ARM
+  if (SHA256_HaveARM()) return SHA256_CompressARM;
+#endif
+  return SHA256_CompressPortable;
+}
+
+/*
+ * SHA256_Compress
+ *
+ * Description:
+ *   Updates the intermediate hash `state` with `count` consecutive
+ *   512-bit message blocks starting at `blocks`.
+ */
+void SHA256_Compress(uint32_t state[8], const uint8_t *blocks,
+    size_t count)
+{
+  SHA256CompressFunc impl = SHA256_LOAD_IMPL();
+  if (!impl) {
+    impl = SHA256_SelectCompress();
+    SHA256_STORE_IMPL(impl);
+  }
+  impl(state, blocks, count);
+}
+
+/*
+ * SHA256_UsePortableCompress
+ *
+ * Description:
+ *   Makes SHA256_Compress use the portable implementation if
+ *   `portable` is nonzero, or the one picked for the CPU otherwise,
+ *   so that tests can check both.
+ *
+ * Returns:
+ *   Nonzero if the CPU has an accelerated implementation.
+ */
+int SHA256_UsePortableCompress(int portable)
+{
+  SHA256CompressFunc selected = SHA256_SelectCompress();
+  SHA256_STORE_IMPL(portable ? SHA256_CompressPortable : selected);
+  return selected != SHA256_CompressPortable;
+}
@@ -0,0 +1,424 @@
+#include "state.h"
+
+#include "lcd.h"
+#include "mcu.h"
+#include "mcu_interrupt.h"
+#include "mcu_timer.h"
+#include "pcm.h"
+#include "submcu.h"
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+static const uint32_t STATE_MAGIC = 0x35354353; // "SC55"
+
+// Large memories are mostly zeroes or repeated bytes, so they are stored PackBits-encoded: a control byte c < 128 is
+// followed by c + 1 literal bytes, c > 128 is followed by one byte repeated 257 - c times. Multi-byte elements are
+// encoded as their little-endian bytes, multi-dimensional arrays in row-major order.
+
+template <typename T>
+static uint8_t STATE_GetByte(const T* elements, size_t index)
+{
+    return (uint8_t)((std::make_unsigned_t<T>)elements[index / sizeof(T)] >> (index % sizeof(T) * 8));
+}
+
+template <typename T>
+static void STATE_SetByte(T* elements, size_t index, uint8_t byte)
+{
+    using U = std::make_unsigned_t<T>;
+    const int shift = index % sizeof(T) * 8;
+    U& element = (U&)elements[index / sizeof(T)];
+    element = (U)((element & ~((U)0xff << shift)) | ((U)byte << shift));
+}
+
+// The writer and reader share STATE_Visit, so the field order is defined in exactly one place.
+
+struct StateWriter
+{
+    std::vector<uint8_t>& out;
+
+    template <typename T>
+    void operator()(T& value)
+    {
+        if constexpr (std::is_array_v<T>)
+        {
+            for (auto& element : value)
+                (*this)(element);
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            out.push_back(value ? 1 : 0);
+        }
+        else
+        {
+            const auto v = static_cast<std::make_unsigned_t<T>>(value);
+            for (size_t i = 0; i < sizeof(T); i++)
+                out.push_back((uint8_t)(v >> (i * 8)));
+        }
+    }
+
+    template <typename T>
+    void Range(T& value, std::type_identity_t<T>, std::type_identity_t<T>)
+    {
+        (*this)(value);
+    }
+
+    template <typename A>
+    void Packed(A& array)
+    {
+        using T = std::remove_all_extents_t<A>;
+        Packed((T*)array, sizeof(A) / sizeof(T));
+    }
+
+    template <typename T>
+    void Packed(T* elements, size_t count)
+    {
+        const size_t size = count * sizeof(T);
+        size_t i = 0;
+        while (i < size)
+        {
+            const uint8_t byte = STATE_GetByte(elements, i);
+            size_t run = 1;
+            while (i + run < size && run < 128 && STATE_GetByte(elements, i + run) == byte)
+                run++;
+            if (run >= 3)
+            {
+                out.push_back((uint8_t)(257 - run));
+                out.push_back(byte);
+                i += run;
+                continue;
+            }
+
+            // literals up to the next run of three or more
+            const size_t start = i;
+            while (i < size && i - start < 128)
+            {
+                if (i + 2 < size && STATE_GetByte(elements, i) == STATE_GetByte(elements, i + 1)
+                    && STATE_GetByte(elements, i) == STATE_GetByte(elements, i + 2))
+                    break;
+                i++;
+            }
+            out.push_back((uint8_t)(i - start - 1));
+            for (size_t j = start; j < i; j++)
+                out.push_back(STATE_GetByte(elements, j));
+        }
+    }
+};
+
+// With `apply` false the input is only validated, so that a bad state is rejected before anything is modified.
+template <bool apply>
+struct StateReader
+{
+    std::span<const uint8_t> in;
+    size_t pos = 0;
+    bool ok = true;
+
+    template <typename T>
+    void operator()(T& value)
+    {
+        if constexpr (std::is_array_v<T>)
+        {
+            for (auto& element : value)
+                (*this)(element);
+        }
+        else
+        {
+            T v{};
+            if (Decode(v) && apply)
+                value = v;
+        }
+    }
+
+    // For fields used as an index or a loop bound: a value outside [min, max] rejects the state, so that a damaged
+    // state can't make the emulator access memory out of bounds.
+    template <typename T>
+    void Range(T& value, std::type_identity_t<T> min, std::type_identity_t<T> max)
+    {
+        T v{};
+        if (!Decode(v))
+            return;
+        if (v < min || v > max)
+        {
+            ok = false;
+            return;
+        }
+        if constexpr (apply)
+            value = v;
+    }
+
+    template <typename T>
+    bool Decode(T& value)
+    {
+        if (in.size() - pos < sizeof(T))
+        {
+            ok = false;
+            pos = in.size();
+            return false;
+        }
+        std::make_unsigned_t<std::conditional_t<std::is_same_v<T, bool>, uint8_t, T>> v = 0;
+        for (size_t i = 0; i < sizeof(T); i++)
+            v |= (decltype(v))in[pos + i] << (i * 8);
+        pos += sizeof(T);
+        value = static_cast<T>(v);
+        return true;
+    }
+
+    template <typename A>
+    void Packed(A& array)
+    {
+        using T = std::remove_all_extents_t<A>;
+        Packed((T*)array, sizeof(A) / sizeof(T));
+    }
+
+    template <typename T>
+    void Packed(T* elements, size_t count)
+    {
+        const size_t size = count * sizeof(T);
+        size_t i = 0;
+        while (i < size)
+        {
+            if (pos >= in.size())
+            {
+                ok = false;
+                return;
+            }
+            const uint8_t control = in[pos++];
+            if (control < 128)
+            {
+                const size_t count = control + 1;
+                if (count > size - i || count > in.size() - pos)
+                {
+                    ok = false;
+                    return;
+                }
+                if constexpr (apply)
+                {
+                    if constexpr (sizeof(T) == 1)
+                        memcpy(&elements[i], &in[pos], count);
+                    else
+                        for (size_t j = 0; j < count; j++)
+                            STATE_SetByte(elements, i + j, in[pos + j]);
+                }
+                pos += count;
+                i += count;
+            }
+            else if (control > 128)
+            {
+                const size_t count = 257 - control;
+                if (count > size - i || pos >= in.size())
+                {
+                    ok = false;
+                    return;
+                }
+                if constexpr (apply)
+                {
+                    if constexpr (sizeof(T) == 1)
+                        memset(&elements[i], in[pos], count);
+                    else
+                        for (size_t j = 0; j < count; j++)
+                            STATE_SetByte(elements, i + j, in[pos]);
+                }
+                pos++;
+                i += count;
+            }
+        }
+    }
+};
+
+template <typename Archive>
+static void STATE_VisitHeader(Archive& ar, uint32_t& magic, uint32_t& version, uint8_t& romset)
+{
+    ar(magic);
+    ar(version);
+    ar(romset);
+}
+
+template <typename Archive>
+static void STATE_Visit(Archive& ar, mcu_t& mcu, submcu_t& sm, mcu_timer_t& timer, pcm_t& pcm, lcd_t& lcd)
+{
+    // mcu
+    ar(mcu.r);
+    ar(mcu.pc);
+    ar(mcu.sr);
+    ar(mcu.cp);
+    ar(mcu.dp);
+    ar(mcu.ep);
+    ar(mcu.tp);
+    ar(mcu.br);
+    ar(mcu.sleep);
+    ar(mcu.ex_ignore);
+    ar(mcu.exception_pending);
+    ar.Range(mcu.interrupt_pending, 0, (1u << INTERRUPT_SOURCE_MAX) - 1);
+    ar(mcu.trapa_pending);
+    ar(mcu.cycles);
+    ar.Packed(mcu.ram);
+    ar.Packed(mcu.sram);
+    if (mcu.is_jv880)
+    {
+        ar.Packed(mcu.nvram, NVRAM_SIZE);
+        ar.Packed(mcu.cardram, CARDRAM_SIZE);
+    }
+    ar(mcu.dev_register);
+    ar(mcu.ad_val);
+    ar(mcu.ad_nibble);
+    ar(mcu.sw_pos);
+    ar(mcu.io_sd);
+    ar.Range(mcu.uart_write_ptr, 0, uart_buffer_size - 1);
+    ar.Range(mcu.uart_read_ptr, 0, uart_buffer_size - 1);
+    ar.Packed(mcu.uart_buffer);
+    ar(mcu.uart_rx_byte);
+    ar(mcu.uart_rx_delay);
+    ar(mcu.uart_tx_delay);
+    ar(mcu.ga_int);
+    ar(mcu.ga_int_enable);
+    ar(mcu.ga_int_trigger);
+    ar(mcu.ga_lcd_counter);
+    ar(mcu.p0_data);
+    ar(mcu.p1_data);
+    ar(mcu.adf_rd);
+    ar(mcu.analog_end_time);
+    ar(mcu.ssr_rd);
+    ar(mcu.operand_type);
+    ar(mcu.operand_ea);
+    ar(mcu.operand_ep);
+    ar(mcu.operand_size);
+    ar.Range(mcu.operand_reg, 0, std::size(mcu.r) - 1);
+    ar(mcu.operand_status);
+    ar(mcu.operand_data);
+    ar(mcu.opcode_extended);
+
+    // sub mcu
+    ar(sm.pc);
+    ar(sm.a);
+    ar(sm.x);
+    ar(sm.y);
+    ar(sm.s);
+    ar(sm.sr);
+    ar(sm.cycles);
+    ar(sm.sleep);
+    ar.Packed(sm.ram);
+    ar.Packed(sm.shared_ram);
+    ar(sm.access);
+    ar(sm.p0_dir);
+    ar(sm.p1_dir);
+    ar(sm.device_mode);
+    ar(sm.cts);
+    ar(sm.timer_cycles);
+    ar(sm.timer_prescaler);
+    ar(sm.timer_counter);
+    ar(sm.uart_rx_gotbyte);
+
+    // timers
+    ar(timer.tcr);
+    ar(timer.tcsr);
+    ar(timer.tcora);
+    ar(timer.tcorb);
+    ar(timer.tcnt);
+    ar(timer.status_rd);
+    ar(timer.cycles);
+    ar(timer.tempreg);
+    for (frt_t& frt : timer.frt)
+    {
+        ar(frt.tcr);
+        ar(frt.tcsr);
+        ar(frt.frc);
+        ar(frt.ocra);
+        ar(frt.ocrb);
+        ar(frt.icr);
+        ar(frt.status_rd);
+    }
+
+    // pcm
+    ar.Packed(pcm.ram1);
+    ar.Packed(pcm.ram2);
+    ar.Range(pcm.select_channel, 0, std::size(pcm.ram1) - 1);
+    ar(pcm.voice_mask);
+    ar(pcm.voice_mask_pending);
+    ar(pcm.voice_mask_updating);
+    ar(pcm.write_latch);
+    ar(pcm.wave_read_address);
+    ar(pcm.wave_byte_latch);
+    ar(pcm.read_latch);
+    ar(pcm.config_reg_3c);
+    ar(pcm.config_reg_3d);
+    ar(pcm.irq_channel);
+    ar(pcm.irq_assert);
+    ar(pcm.config.noise_mask);
+    ar(pcm.config.orval);
+    ar(pcm.config.write_mask);
+    ar(pcm.config.dac_mask);
+    ar(pcm.config.oversampling);
+    ar.Range(pcm.config.reg_slots, 1, std::size(pcm.ram1));
+    ar(pcm.nfs);
+    ar(pcm.tv_counter);
+    ar(pcm.cycles);
+    ar.Packed(pcm.eram);
+    ar(pcm.accum_l);
+    ar(pcm.accum_r);
+    ar(pcm.rcsum);
+
+    // lcd
+    ar(lcd.LCD_DL);
+    ar(lcd.LCD_N);
+    ar(lcd.LCD_F);
+    ar(lcd.LCD_D);
+    ar(lcd.LCD_C);
+    ar(lcd.LCD_B);
+    ar(lcd.LCD_ID);
+    ar(lcd.LCD_S);
+    ar.Range(lcd.LCD_DD_RAM, 0, 0x7f);
+    ar.Range(lcd.LCD_AC, 0, 0x7f);
+    ar.Range(lcd.LCD_CG_RAM, 0, std::size(lcd.LCD_CG) - 1);
+    ar(lcd.LCD_RAM_MODE);
+    ar(lcd.LCD_Data);
+    ar(lcd.LCD_CG);
+    uint8_t enable = lcd.enable;
+    ar(enable);
+    lcd.enable = enable;
+}
+
+void STATE_Save(std::vector<uint8_t>& out, mcu_t& mcu, submcu_t& sm, mcu_timer_t& timer, pcm_t& pcm, lcd_t& lcd)
+{
+    // bring lazily updated state up to date so that it is fully described by the fields below
+    MCU_SyncFlags(mcu);
+    TIMER_Clock(timer, mcu.cycles);
+
+    uint32_t magic = STATE_MAGIC;
+    uint32_t version = STATE_VERSION;
+    uint8_t romset = (uint8_t)mcu.romset;
+
+    out.clear();
+
+    StateWriter writer{out};
+    STATE_VisitHeader(writer, magic, version, romset);
+    STATE_Visit(writer, mcu, sm, timer, pcm, lcd);
+}
+
+bool STATE_Load(std::span<const uint8_t> data, mcu_t& mcu, submcu_t& sm, mcu_timer_t& timer, pcm_t& pcm,
+                lcd_t& lcd)
+{
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint8_t romset = 0;
+
+    StateReader<true> header{data};
+    STATE_VisitHeader(header, magic, version, romset);
+    if (!header.ok || magic != STATE_MAGIC || version != STATE_VERSION || romset != (uint8_t)mcu.romset)
+        return false;
+
+    StateReader<false> check{data, header.pos};
+    STATE_Visit(check, mcu, sm, timer, pcm, lcd);
+    if (!check.ok || check.pos != data.size())
+        return false;
+
+    StateReader<true> reader{data, header.pos};
+    STATE_Visit(reader, mcu, sm, timer, pcm, lcd);
+
+    // derived state is rebuilt rather than stored
+    mcu.flags_op = FLAGS_NONE;
+    mcu.interrupt_check = 1;
+    mcu.next_event = 0;
+    MCU_UpdatePageTable(mcu);
+
+    return true;
+}
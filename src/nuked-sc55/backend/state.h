@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct mcu_t;
+struct submcu_t;
+struct mcu_timer_t;
+struct pcm_t;
+struct lcd_t;
+
+// Bumped whenever the layout written by STATE_Save changes. States with a different version are rejected.
+static const uint32_t STATE_VERSION = 3;
+
+// Serializes the mutable state of every emulator component into `out`, replacing its contents. ROM contents,
+// callbacks and host-side settings (e.g. `pcm.disable_oversampling`) are not included. All values are stored
+// little-endian, and RAM contents are run-length encoded, so a state is never much larger than the ~140 KB of raw
+// state and usually far smaller.
+void STATE_Save(std::vector<uint8_t>& out, mcu_t& mcu, submcu_t& sm, mcu_timer_t& timer, pcm_t& pcm, lcd_t& lcd);
+
+// Restores state written by STATE_Save. The emulator must have the same romset loaded as when the state was saved.
+// The state is decoded directly into the emulator structs; `data` is validated in a first pass, so this returns false
+// without touching the emulator if it is not a valid state for it.
+bool STATE_Load(std::span<const uint8_t> data, mcu_t& mcu, submcu_t& sm, mcu_timer_t& timer, pcm_t& pcm,
+                lcd_t& lcd);
@@ -59,7 +59,7 @@ struct submcu_t {
     uint64_t cycles = 0;
     uint8_t sleep = 0;
     mcu_t* mcu = nullptr;
-    uint8_t rom[4096]{};
+    const uint8_t* rom = nullptr; // ROMSM_SIZE bytes, read-only
 
     uint8_t ram[128]{};
     uint8_t shared_ram[192]{};
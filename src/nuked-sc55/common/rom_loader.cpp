@@ -94,6 +94,8 @@ LoadRomsetError LoadRomset(AllRomsetInfo&               romset_info,
             {
                 romset_info.romsets[i].rom_paths[j] = overrides[j];
                 romset_info.romsets[i].rom_data[j].clear();
+                romset_info.romsets[i].rom_digests[j].reset();
+                romset_info.romsets[i].rom_images[j].reset();
             }
         }
     }
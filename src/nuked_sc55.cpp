@@ -1,12 +1,23 @@
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
 #include <string>
 
 #include "nuked_sc55.h"
+#include "nuked-sc55/backend/state.h"
 #include "nuked-sc55/common/rom_loader.h"
 
+extern "C" {
+#include "nuked-sc55/backend/sha/sha.h"
+}
+
 // #define DEBUG
 
 //----------------------------------------------------------------------------
@@ -52,9 +63,75 @@ static void log_shutdown() {}
 //----------------------------------------------------------------------------
 
 extern std::string plugin_path;
+extern const char* plugin_version;
+
+//----------------------------------------------------------------------------
+// Boot state cache
+//
+// Booting the emulated device takes millions of MCU steps, so the emulator
+// state right after boot is kept in memory, shared by all instances that use
+// the same ROMs, and persisted next to the ROMs so later sessions can skip
+// booting as well.
+
+static std::mutex boot_states_mutex;
+
+static std::map<std::string, std::shared_ptr<const std::vector<uint8_t>>> boot_states;
+
+// The ROMs are identified by the digests found while detecting them, so
+// their contents are only hashed if a ROM was found some other way.
+static std::string make_boot_state_key(const RomsetInfo& info)
+{
+    SHA256Context ctx;
+    SHA256Reset(&ctx);
+
+    for (size_t i = 0; i < ROMLOCATION_COUNT; i++) {
+        RomDigest rom_digest;
+
+        if (info.rom_digests[i]) {
+            rom_digest = *info.rom_digests[i];
+        } else if (info.HasRom(static_cast<RomLocation>(i))) {
+            SHA256Context rom_ctx;
+            SHA256Reset(&rom_ctx);
+
+            if (const auto& image = info.rom_images[i]) {
+                SHA256Input(&rom_ctx, image->data, static_cast<unsigned int>(image->size));
+            } else {
+                const auto& data = info.rom_data[i];
+                SHA256Input(&rom_ctx, data.data(), static_cast<unsigned int>(data.size()));
+            }
+            SHA256Result(&rom_ctx, rom_digest.data());
+        } else {
+            continue;
+        }
+
+        const uint8_t location = static_cast<uint8_t>(i);
+        SHA256Input(&ctx, &location, 1);
+        SHA256Input(&ctx, rom_digest.data(), static_cast<unsigned int>(rom_digest.size()));
+    }
+    SHA256Input(&ctx,
+                reinterpret_cast<const uint8_t*>(plugin_version),
+                static_cast<unsigned int>(strlen(plugin_version)));
+
+    const uint32_t state_version = STATE_VERSION;
+    SHA256Input(&ctx,
+                reinterpret_cast<const uint8_t*>(&state_version),
+                static_cast<unsigned int>(sizeof(state_version)));
+
+    uint8_t digest[SHA256HashSize];
+    SHA256Result(&ctx, digest);
+
+    std::string key;
+    for (const auto byte : digest) {
+        char hex[3];
+        snprintf(hex, sizeof(hex), "%02x", byte);
+        key += hex;
+    }
+    return key;
+}
 
 NukedSc55::NukedSc55(const clap_plugin_t _plugin_class,
-                     const clap_host_t* _host, const Model _model)
+                     const clap_host_t* _host, const Model _model,
+                     const Options& options)
 {
     log_init();
 
@@ -67,6 +144,9 @@ NukedSc55::NukedSc55(const clap_plugin_t _plugin_class,
 
     host  = _host;
     model = _model;
+
+    resample_quality    = options.resample_quality;
+    render_ahead_frames = options.render_ahead_frames;
 }
 
 const clap_plugin_t* NukedSc55::GetPluginClass()
@@ -103,6 +183,9 @@ bool NukedSc55::Init(const clap_plugin* _plugin_instance)
 
     plugin_instance = _plugin_instance;
 
+    host_tail = static_cast<const clap_host_tail_t*>(
+        host->get_extension(host, CLAP_EXT_TAIL));
+
     emu = std::make_unique<Emulator>();
 
     const EMU_Options opts = {.lcd_backend = nullptr, .nvram_filename = std::filesystem::path{}};
@@ -130,6 +213,12 @@ bool NukedSc55::Init(const clap_plugin* _plugin_instance)
     log("ROM dir: %s", rom_path.c_str());
 
     AllRomsetInfo romset_info{};
+    // Hashing the ROM files and unscrambling the waveroms is slow, so keep
+    // their digests and unscrambled copies around; both are skipped if the
+    // directory isn't writable.
+    romset_info.waverom_cache_dir = rom_path / "cache";
+    romset_info.rom_index_path    = rom_path / "cache" / "rom_index.txt";
+
     common::LoadRomsetResult load_result{};
     common::RomOverrides rom_overrides;
     common::LoadRomsetError err = common::LoadRomset(romset_info, rom_path, romset, false, rom_overrides, load_result);
@@ -138,6 +227,9 @@ bool NukedSc55::Init(const clap_plugin* _plugin_instance)
         emu.reset(nullptr);
         return false;
     }
+    boot_state_key  = make_boot_state_key(romset_info.romsets[(size_t)load_result.romset]);
+    boot_state_path = rom_path / "boot.state";
+
     RomLocationSet loaded{};
     if (!emu->LoadRoms(load_result.romset, romset_info, &loaded)) {
         log("emu->LoadRoms failed");
@@ -145,6 +237,13 @@ bool NukedSc55::Init(const clap_plugin* _plugin_instance)
         return false;
     }
 
+    // The emulator holds on to the ROM images it needs
+    romset_info.PurgeRomData();
+
+    [[maybe_unused]] const EMU_MemoryUsage usage = emu->GetMemoryUsage();
+    log("Memory usage: %zu bytes (state: %zu, roms heap: %zu, roms mapped: %zu)",
+        usage.Total(), usage.state + usage.lcd_buffer + usage.jv880_ram, usage.roms_heap, usage.roms_mapped);
+
     return true;
 }
 
@@ -152,6 +251,8 @@ void NukedSc55::Shutdown()
 {
     log("Shutdown");
 
+    StopRenderAhead();
+
     if (resampler) {
         speex_resampler_destroy(resampler);
         resampler = nullptr;
@@ -159,17 +260,6 @@ void NukedSc55::Shutdown()
     log_shutdown();
 }
 
-static void receive_sample(void* userdata, const AudioFrame<int32_t>& in)
-{
-    assert(userdata);
-    auto emu = reinterpret_cast<NukedSc55*>(userdata);
-
-    AudioFrame<float> out = {};
-    Normalize(in, out);
-
-    emu->PublishFrame(out.left, out.right);
-}
-
 bool NukedSc55::Activate(const double requested_sample_rate,
                          const uint32_t min_frame_count,
                          const uint32_t max_frame_count)
@@ -179,76 +269,179 @@ bool NukedSc55::Activate(const double requested_sample_rate,
         min_frame_count,
         max_frame_count);
 
-    emu->Reset();
-    emu->GetPCM().disable_oversampling = true;
-    emu->PostSystemReset(EMU_SystemReset::GS_RESET);
+    StopRenderAhead();
+
+    // Hosts usually load the project's state between Init and Activate, and
+    // re-activate whenever the sample rate or block size changes; neither
+    // should lose the emulator state
+    if (!has_emu_state) {
+        emu->Reset();
+
+        if (!RestoreBootState()) {
+            emu->PostSystemReset(EMU_SystemReset::GS_RESET);
+
+            // Speed up the devices' bootup delay. A sleeping MCU covers many
+            // instruction slots in one step, so run for a fixed emulated
+            // time (12 cycles per slot) rather than a number of steps.
+            const uint64_t num_steps = (model == Model::Sc55mk2_v1_01) ? 9'500'000 : 700'000;
 
-    // Speed up the devices' bootup delay
-    const size_t num_steps = (model == Model::Sc55mk2_v1_01) ? 9'500'000 : 700'000;
+            const uint64_t end = emu->GetMCU().cycles + num_steps * 12;
+            while (emu->GetMCU().cycles < end) {
+                emu->Step();
+            }
 
-    for (size_t i = 0; i < num_steps; i++) {
-        MCU_Step(emu->GetMCU());
+            StoreBootState();
+        }
+        has_emu_state = true;
     }
+    emu->GetPCM().disable_oversampling = true;
 
-    emu->SetSampleCallback(receive_sample, this);
+    emu->SetSampleSink(sink_buf);
 
     render_sample_rate_hz = PCM_GetOutputFrequency(emu->GetPCM());
 
     log("render_sample_rate_hz: %g", render_sample_rate_hz);
 
+    // Longer than the effect RAM can delay anything (0x4000 words, about
+    // half a second) and than the firmware takes to settle after a reset
+    constexpr double MinIdleSeconds = 2.0;
+
+    min_idle_frames = static_cast<uint64_t>(render_sample_rate_hz * MinIdleSeconds);
+    ResetIdle();
+
+    tail_level_measured = false;
+    SetTail(InfiniteTail);
+
     if (requested_sample_rate != render_sample_rate_hz) {
         do_resample = true;
 
         output_sample_rate_hz = requested_sample_rate;
 
-        // Initialise Speex resampler
         resample_ratio = render_sample_rate_hz / output_sample_rate_hz;
 
         const spx_uint32_t in_rate_hz = static_cast<int>(render_sample_rate_hz);
         const spx_uint32_t out_rate_hz = static_cast<int>(output_sample_rate_hz);
 
-        constexpr auto NumChannels     = 2; // always stereo
-        constexpr auto ResampleQuality = SPEEX_RESAMPLER_QUALITY_DESKTOP;
+        if (resampler) {
+            speex_resampler_destroy(resampler);
+            resampler = nullptr;
+        }
 
-        resampler = speex_resampler_init(
-            NumChannels, in_rate_hz, out_rate_hz, ResampleQuality, nullptr);
+        use_polyphase_resampler = PolyphaseResampler::IsSupported(in_rate_hz,
+                                                                  out_rate_hz);
+        if (use_polyphase_resampler) {
+            polyphase_resampler.Init(in_rate_hz, out_rate_hz, resample_quality);
 
-        speex_resampler_set_rate(resampler, in_rate_hz, out_rate_hz);
-        speex_resampler_skip_zeros(resampler);
+        } else {
+            // Initialise Speex resampler
+            constexpr auto NumChannels     = 2; // always stereo
+            constexpr auto ResampleQuality = SPEEX_RESAMPLER_QUALITY_DESKTOP;
 
-        const auto max_render_buf_size = static_cast<size_t>(
-            static_cast<double>(max_frame_count) * resample_ratio * 1.10f);
+            resampler = speex_resampler_init(
+                NumChannels, in_rate_hz, out_rate_hz, ResampleQuality, nullptr);
 
-        render_buf[0].reserve(max_render_buf_size);
-        render_buf[1].reserve(max_render_buf_size);
+            speex_resampler_set_rate(resampler, in_rate_hz, out_rate_hz);
+            speex_resampler_skip_zeros(resampler);
+
+            // The ring holds interleaved frames, so the resampler reads every
+            // other sample
+            speex_resampler_set_input_stride(resampler, 2);
+        }
 
     } else {
         do_resample = false;
 
         output_sample_rate_hz = render_sample_rate_hz;
         resample_ratio        = 1.0;
+    }
 
-        render_buf[0].reserve(max_frame_count);
-        render_buf[1].reserve(max_frame_count);
+    // Process() renders a block's worth of frames ahead at most, plus
+    // whatever the resampler left unconsumed, so twice that is plenty
+    const auto max_render_frames = static_cast<size_t>(
+        std::ceil(static_cast<double>(max_frame_count) * resample_ratio));
+
+    const auto render_buf_size = std::bit_ceil(max_render_frames * 2 + 64) *
+                                 sizeof(AudioFrame<float>);
+
+    if (!render_buf_storage.Init(render_buf_size)) {
+        log("Could not allocate render buffer");
+        return false;
+    }
+    render_buf = RingbufferView(render_buf_storage);
+
+    constexpr size_t MidiQueueSize = 4096 * sizeof(QueuedMidi);
+
+    if (!midi_queue_storage.Init(MidiQueueSize)) {
+        log("Could not allocate MIDI queue");
+        return false;
     }
+    midi_queue = RingbufferView(midi_queue_storage);
 
     log("do_resample: %s", do_resample ? "true" : "false");
+    log("use_polyphase_resampler: %s", use_polyphase_resampler ? "true" : "false");
     log("output_sample_rate_hz: %g", output_sample_rate_hz);
     log("resample_ratio: %g", resample_ratio);
 
+    if (render_ahead_frames > 0 && !StartRenderAhead(max_frame_count)) {
+        log("Could not start render-ahead worker");
+        return false;
+    }
+    log("render_ahead_frames: %d", GetLatency());
+
     return true;
 }
 
+void NukedSc55::Deactivate()
+{
+    log("Deactivate");
+
+    // The worker has nothing to do until the next Activate
+    StopRenderAhead();
+}
+
+uint32_t NukedSc55::GetLatency() const
+{
+    return render_ahead ? render_ahead_frames : 0;
+}
+
+uint32_t NukedSc55::GetTail() const
+{
+    const uint32_t tail = tail_frames;
+
+    // In render-ahead mode, the frames waiting in the output queue come on
+    // top of what the emulator has yet to render
+    return (tail == InfiniteTail) ? tail : tail + GetLatency();
+}
+
 clap_process_status NukedSc55::Process(const clap_process_t* process)
 {
     if (!emu) {
         return CLAP_PROCESS_ERROR;
     }
 
+    if (render_ahead) {
+        return ProcessRenderAhead(process);
+    }
+
     assert(process->audio_outputs_count == 1);
     assert(process->audio_inputs_count == 0);
 
     const uint32_t num_frames = process->frames_count;
+
+    // Only ever contended while the host saves or loads state, which holds
+    // the lock for a whole STATE_Save or STATE_Load. Output silence rather
+    // than wait for it, and keep the block's MIDI for the next block so that
+    // no note-off gets lost.
+    std::unique_lock lock(emu_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        DeferEvents(process->in_events);
+
+        std::fill_n(process->audio_outputs[0].data32[0], num_frames, 0.0f);
+        std::fill_n(process->audio_outputs[0].data32[1], num_frames, 0.0f);
+        return CLAP_PROCESS_CONTINUE;
+    }
+    PostDeferredMidi();
+
     const uint32_t num_events = process->in_events->size(process->in_events);
     log("--- num_frames: %d, num_events: %d", num_frames, num_events);
 
@@ -275,11 +468,10 @@ clap_process_status NukedSc55::Process(const clap_process_t* process)
             }
         }
 
-        const auto num_frames_to_render = static_cast<int>(
-            static_cast<double>(next_event_frame - curr_frame) * resample_ratio);
-
-        // Render samples until the next event
-        RenderAudio(num_frames_to_render);
+        // Render samples until the next event; frames left over from the
+        // previous block count towards this
+        RenderAudio(static_cast<uint32_t>(
+            static_cast<double>(next_event_frame) * resample_ratio));
 
         curr_frame = next_event_frame;
     }
@@ -287,26 +479,99 @@ clap_process_status NukedSc55::Process(const clap_process_t* process)
     auto out_left  = process->audio_outputs[0].data32[0];
     auto out_right = process->audio_outputs[0].data32[1];
 
-    if (do_resample) {
-        ResampleAndPublishFrames(num_frames, out_left, out_right);
+    RenderOutput(num_frames, out_left, out_right);
 
-    } else {
-	assert(out_left && out_right);
+    return GetProcessStatus();
+}
+
+clap_process_status NukedSc55::GetProcessStatus()
+{
+    if (tail_changed.exchange(false) && host_tail) {
+        host_tail->changed(host);
+    }
+
+    if (idle) {
+        return CLAP_PROCESS_SLEEP;
+    }
+    // Once the last voice has stopped, the host may stop calling us when the
+    // tail runs out
+    return (tail_frames == InfiniteTail) ? CLAP_PROCESS_CONTINUE
+                                         : CLAP_PROCESS_TAIL;
+}
+
+bool NukedSc55::RestoreBootState()
+{
+    std::shared_ptr<const std::vector<uint8_t>> state = nullptr;
+    {
+        std::lock_guard lock(boot_states_mutex);
 
-	assert(render_buf.size() == 2);
-	assert(render_buf[0].size() >= num_frames);
-	assert(render_buf[1].size() >= num_frames);
+        if (const auto it = boot_states.find(boot_state_key); it != boot_states.end()) {
+            state = it->second;
+        }
+    }
 
-        for (size_t i = 0; i < num_frames; ++i) {
-            out_left[i]  = render_buf[0][i];
-            out_right[i] = render_buf[1][i];
+    if (!state) {
+        // The file starts with the key it was stored under, followed by the
+        // serialised emulator state
+        std::ifstream file(boot_state_path, std::ios::binary);
+        if (!file) {
+            return false;
         }
 
-        render_buf[0].clear();
-        render_buf[1].clear();
+        std::string key(boot_state_key.size(), '\0');
+        if (!file.read(key.data(), key.size()) || key != boot_state_key) {
+            log("Stale boot state file: %s", boot_state_path.c_str());
+            return false;
+        }
+
+        auto data = std::make_shared<std::vector<uint8_t>>(
+            std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+        std::lock_guard lock(boot_states_mutex);
+        state = boot_states.try_emplace(boot_state_key, std::move(data)).first->second;
+    }
+
+    if (!emu->LoadState(*state)) {
+        log("Invalid boot state, booting from scratch");
+        return false;
+    }
+
+    log("Restored boot state");
+    return true;
+}
+
+void NukedSc55::StoreBootState()
+{
+    auto data = std::make_shared<std::vector<uint8_t>>();
+    emu->SaveState(*data);
+
+    {
+        std::lock_guard lock(boot_states_mutex);
+        boot_states.insert_or_assign(boot_state_key, data);
     }
 
-    return CLAP_PROCESS_CONTINUE;
+    // Persisting is best-effort; the ROM directory might not be writable.
+    // Write to a temporary file first so concurrent readers never see a
+    // partial state.
+    const auto tmp_path = MakeTempPath(boot_state_path);
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(boot_state_key.data(), boot_state_key.size());
+        file.write(reinterpret_cast<const char*>(data->data()), data->size());
+        if (!file) {
+            log("Could not write boot state file: %s", tmp_path.c_str());
+            file.close();
+            std::error_code err;
+            std::filesystem::remove(tmp_path, err);
+            return;
+        }
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmp_path, boot_state_path, err);
+    if (err) {
+        std::filesystem::remove(tmp_path, err);
+    }
 }
 
 bool NukedSc55::LoadState(const clap_istream_t* stream)
@@ -315,18 +580,64 @@ bool NukedSc55::LoadState(const clap_istream_t* stream)
         return false;
     }
 
-    // TODO return true once implemented
-    return false;
+    // Read the whole state before taking the lock so the audio thread is
+    // never held up by the host's stream
+    load_state_buf.clear();
+
+    uint8_t chunk[4096];
+    for (;;) {
+        const auto num_read = stream->read(stream, chunk, sizeof(chunk));
+        if (num_read < 0) {
+            log("LoadState: read error");
+            return false;
+        }
+        if (num_read == 0) {
+            break;
+        }
+        load_state_buf.insert(load_state_buf.end(), chunk, chunk + num_read);
+    }
+
+    log("LoadState: %zu bytes", load_state_buf.size());
+
+    // The host may call this from the main thread while the audio thread
+    // is processing
+    std::lock_guard lock(emu_mutex);
+
+    if (!emu->LoadState(load_state_buf)) {
+        log("LoadState: invalid state");
+        return false;
+    }
+    has_emu_state = true;
+    ResetIdle();
+
+    return true;
 }
 
 bool NukedSc55::SaveState(const clap_ostream_t* stream)
 {
     if (!emu) {
-        return 0;
+        return false;
+    }
+
+    {
+        std::lock_guard lock(emu_mutex);
+        emu->SaveState(save_state_buf);
     }
 
-    // TODO return actual number of bytes written once implemented
-    return 0;
+    log("SaveState: %zu bytes", save_state_buf.size());
+
+    size_t pos = 0;
+    while (pos < save_state_buf.size()) {
+        const auto num_written = stream->write(
+            stream, save_state_buf.data() + pos, save_state_buf.size() - pos);
+
+        if (num_written <= 0) {
+            log("SaveState: write error");
+            return false;
+        }
+        pos += static_cast<size_t>(num_written);
+    }
+    return true;
 }
 
 void NukedSc55::Flush(const clap_input_events_t* in, const clap_output_events_t* out)
@@ -337,20 +648,26 @@ void NukedSc55::Flush(const clap_input_events_t* in, const clap_output_events_t*
 
     log("Flush");
 
+    // Same as in Process; the worker owns the emulator in render-ahead mode
+    std::unique_lock lock(emu_mutex, std::defer_lock);
+    if (!render_ahead) {
+        if (!lock.try_lock()) {
+            DeferEvents(in);
+            return;
+        }
+        PostDeferredMidi();
+    }
+
     const uint32_t num_events = in->size(in);
 
-    // Process events sent to our plugin from the host.
+    // Process events sent to our plugin from the host. In render-ahead mode
+    // they take effect at the start of the next block.
     for (uint32_t event_index = 0; event_index < num_events; ++event_index) {
-        ProcessEvent(in->get(in, event_index));
+        ProcessEvent(in->get(in, event_index),
+                     num_frames_played + render_ahead_frames);
     }
 }
 
-void NukedSc55::PublishFrame(const float left, const float right)
-{
-    render_buf[0].emplace_back(left);
-    render_buf[1].emplace_back(right);
-}
-
 constexpr uint8_t NoteOff         = 0x80;
 constexpr uint8_t NoteOn          = 0x90;
 constexpr uint8_t PolyKeyPressure = 0xa0;
@@ -401,7 +718,7 @@ constexpr uint8_t PitchBend       = 0xe0;
     }
 }
 
-void NukedSc55::ProcessEvent(const clap_event_header_t* event)
+void NukedSc55::ProcessEvent(const clap_event_header_t* event, const uint64_t frame)
 {
     if (event->space_id == CLAP_CORE_EVENT_SPACE_ID) {
 
@@ -409,8 +726,7 @@ void NukedSc55::ProcessEvent(const clap_event_header_t* event)
         case CLAP_EVENT_MIDI: {
             const auto midi_event = reinterpret_cast<const clap_event_midi_t*>(event);
 
-            emu->PostMIDI(midi_event->data[0]);
-            emu->PostMIDI(midi_event->data[1]);
+            size_t size = 2;
 
             // 3-byte messages
             const auto status = midi_event->data[0] & 0xf0;
@@ -420,8 +736,10 @@ void NukedSc55::ProcessEvent(const clap_event_header_t* event)
             case NoteOn:
             case PolyKeyPressure:
             case ControlChange:
-            case PitchBend: emu->PostMIDI(midi_event->data[2]); break;
+            case PitchBend: size = 3; break;
             }
+
+            PostMidi(frame, std::span{midi_event->data, size});
 #ifdef DEBUG
             log_midi_message(midi_event);
 #endif
@@ -431,7 +749,7 @@ void NukedSc55::ProcessEvent(const clap_event_header_t* event)
             const auto sysex_event = reinterpret_cast<const clap_event_midi_sysex*>(
                 event);
 
-            emu->PostMIDI(std::span{sysex_event->buffer, sysex_event->size});
+            PostMidi(frame, std::span{sysex_event->buffer, sysex_event->size});
 
             log("SysEx message, length: %d", sysex_event->size);
         } break;
@@ -439,17 +757,230 @@ void NukedSc55::ProcessEvent(const clap_event_header_t* event)
     }
 }
 
+void NukedSc55::PostMidi(const uint64_t frame, std::span<const uint8_t> bytes)
+{
+    if (!render_ahead && !defer_midi) {
+        ResetIdle();
+        emu->PostMIDI(bytes);
+        return;
+    }
+
+    // The worker owns the emulator; it posts the bytes once it has rendered
+    // up to `frame`. Deferred bytes are posted by PostDeferredMidi instead.
+    while (!bytes.empty()) {
+        if (midi_queue.GetWritableElements<QueuedMidi>() == 0) {
+            log("MIDI queue full, dropping %zu bytes", bytes.size());
+            return;
+        }
+
+        QueuedMidi entry = {};
+        entry.frame      = frame;
+        entry.size       = static_cast<uint8_t>(std::min(bytes.size(), sizeof(entry.data)));
+
+        memcpy(entry.data, bytes.data(), entry.size);
+        midi_queue.UncheckedWriteOne(entry);
+
+        bytes = bytes.subspan(entry.size);
+    }
+}
+
+void NukedSc55::DeferEvents(const clap_input_events_t* in)
+{
+    defer_midi = true;
+
+    const uint32_t num_events = in->size(in);
+    for (uint32_t event_index = 0; event_index < num_events; ++event_index) {
+        ProcessEvent(in->get(in, event_index));
+    }
+
+    defer_midi = false;
+}
+
+void NukedSc55::PostDeferredMidi()
+{
+    while (midi_queue.GetReadableElements<QueuedMidi>() > 0) {
+        const auto& entry = midi_queue.PrepareContiguousRead<QueuedMidi>()[0];
+
+        ResetIdle();
+        emu->PostMIDI(std::span{entry.data, entry.size});
+
+        midi_queue.FinishContiguousRead<QueuedMidi>(1);
+    }
+}
+
 void NukedSc55::RenderAudio(const uint32_t num_frames)
 {
-    const auto start_size = render_buf[0].size();
+    // Renders until at least `num_frames` frames are buffered
+    auto num_buffered = render_buf.GetReadableElements<AudioFrame<float>>();
+
+    log("RenderAudio: num_frames: %d, buffered: %d", num_frames, num_buffered);
+
+    while (num_buffered < num_frames) {
+        if (idle) {
+            // Nothing changes until the next MIDI message, so pad with
+            // silence instead of emulating (see UpdateIdle)
+            const auto dest = render_buf.PrepareContiguousWrite<AudioFrame<float>>();
+            const auto n    = std::min<size_t>(dest.size(), num_frames - num_buffered);
+
+            std::fill_n(dest.begin(), n, AudioFrame<float>{});
+
+            render_buf.FinishContiguousWrite<AudioFrame<float>>(n);
+            num_buffered += n;
+            continue;
+        }
+
+        // Stop while a step can't overflow the sink, so no frame is dropped
+        const auto num_to_render = std::min<size_t>(
+            num_frames - num_buffered, sink_buf.size() - EMU_MAX_FRAMES_PER_STEP);
+
+        emu->SetSampleSink(sink_buf);
+
+        while (emu->GetSampleSinkCount() < num_to_render) {
+            emu->Step();
+        }
+
+        const auto frames = std::span(sink_buf).first(emu->GetSampleSinkCount());
+
+        UpdateIdle(frames);
+        UpdateTail(frames.size());
+
+        PublishFrames(frames);
+
+        num_buffered = render_buf.GetReadableElements<AudioFrame<float>>();
+    }
+}
+
+void NukedSc55::PublishFrames(std::span<const AudioFrame<int32_t>> frames)
+{
+    // The ring is sized in Activate so that it never fills up
+    assert(render_buf.GetWritableElements<AudioFrame<float>>() >= frames.size());
+
+    while (!frames.empty()) {
+        const auto dest = render_buf.PrepareContiguousWrite<AudioFrame<float>>();
+        if (dest.empty()) {
+            return;
+        }
+
+        const auto n = std::min(dest.size(), frames.size());
+        Normalize(frames.first(n), dest);
+
+        render_buf.FinishContiguousWrite<AudioFrame<float>>(n);
+        frames = frames.subspan(n);
+    }
+}
+
+// Output level below which the emulator counts as quiet; about -90 dBFS
+// (see Normalize). The effect RAM and accumulators are 12 bits narrower.
+constexpr int32_t QuietLevel         = 1 << 14;
+constexpr int32_t ResidualQuietLevel = QuietLevel >> 12;
+
+void NukedSc55::UpdateIdle(std::span<const AudioFrame<int32_t>> frames)
+{
+    const auto is_quiet = [](const int32_t sample) {
+        return sample > -QuietLevel && sample < QuietLevel;
+    };
+
+    bool quiet = PCM_GetActiveVoices(emu->GetPCM()) == 0 && !emu->HasPendingMIDI();
 
-    log("RenderAudio: num_frames: %d, start_size: %d", num_frames, start_size);
+    for (size_t i = 0; quiet && i < frames.size(); ++i) {
+        quiet = is_quiet(frames[i].left) && is_quiet(frames[i].right);
+    }
+
+    if (!quiet) {
+        ResetIdle();
+        return;
+    }
+    num_quiet_frames += frames.size();
+
+    // The reverb and chorus can keep recirculating below the output level
+    // for a while. Scanning the effect RAM is comparatively slow, so it's
+    // only done once everything else has been quiet for long enough.
+    if (!idle && num_quiet_frames >= min_idle_frames) {
+        const int effect_peak = PCM_GetEffectPeak(emu->GetPCM());
+        log("Effect RAM peak: %d", effect_peak);
 
-    while (render_buf[0].size() - start_size < num_frames) {
-        MCU_Step(emu->GetMCU());
+        idle = effect_peak < ResidualQuietLevel;
     }
+}
 
-    log("  num_rendered: %d", render_buf[0].size() - start_size);
+void NukedSc55::ResetIdle()
+{
+    num_quiet_frames = 0;
+    idle             = false;
+}
+
+void NukedSc55::UpdateTail(const size_t num_frames)
+{
+    // Measuring reads the whole effect RAM, so it's only done every so often
+    constexpr uint64_t MeasureIntervalFrames = 4096;
+
+    // Longer than the longest reverb or delay the firmware can set up; the
+    // tail of a sound that isn't decaying (yet) is assumed to be this long
+    constexpr double MaxTailSeconds = 10.0;
+
+    if (idle) {
+        SetTail(0);
+        return;
+    }
+
+    if (PCM_GetActiveVoices(emu->GetPCM()) != 0 || emu->HasPendingMIDI()) {
+        // Notes can be held indefinitely
+        tail_level_measured = false;
+        SetTail(InfiniteTail);
+        return;
+    }
+
+    const double max_tail_frames = render_sample_rate_hz * MaxTailSeconds;
+
+    tail_level_age += num_frames;
+
+    if (!tail_level_measured || tail_level_age >= MeasureIntervalFrames) {
+        const double level = PCM_GetResidualLevel(emu->GetPCM());
+
+        if (level < ResidualQuietLevel) {
+            tail_decay_frames = 0.0;
+
+        } else if (tail_level_measured && level < tail_level) {
+            // Assume an exponential decay at the rate since the last
+            // measurement
+            tail_decay_frames = static_cast<double>(tail_level_age) *
+                                std::log2(level / ResidualQuietLevel) /
+                                std::log2(tail_level / level);
+        } else {
+            tail_decay_frames = max_tail_frames;
+        }
+        tail_decay_frames = std::min(tail_decay_frames, max_tail_frames);
+
+        log("Residual level: %g, decay frames: %g", level, tail_decay_frames);
+
+        tail_level          = level;
+        tail_level_age      = 0;
+        tail_level_measured = true;
+
+    } else {
+        tail_decay_frames = std::max(tail_decay_frames - num_frames, 0.0);
+    }
+
+    // Never shorter than it takes the emulator to go idle by itself. That
+    // also covers a note the firmware has read but not started a voice for.
+    const auto num_idle_frames = min_idle_frames -
+                                 std::min(num_quiet_frames, min_idle_frames);
+
+    const double tail = std::max(tail_decay_frames,
+                                 static_cast<double>(num_idle_frames));
+
+    SetTail(static_cast<uint32_t>(std::ceil(tail / resample_ratio)));
+}
+
+void NukedSc55::SetTail(const uint32_t num_frames)
+{
+    const auto prev = tail_frames.exchange(num_frames);
+
+    // Hosts count finite tails down by themselves; they only need to hear
+    // about the first voice starting or the last one stopping
+    if ((prev == InfiniteTail) != (num_frames == InfiniteTail)) {
+        tail_changed = true;
+    }
 }
 
 void NukedSc55::ResampleAndPublishFrames(const uint32_t num_out_frames,
@@ -457,87 +988,272 @@ void NukedSc55::ResampleAndPublishFrames(const uint32_t num_out_frames,
 {
     log("RenderAndPublishFrames: num_out_frames: %d", num_out_frames);
 
-    const auto input_len  = render_buf[0].size();
-    const auto output_len = num_out_frames;
-
-    log("  input_len: %d", input_len);
-
-    spx_uint32_t in_len  = input_len;
-    spx_uint32_t out_len = output_len;
-
-    speex_resampler_process_float(
-        resampler, 0, render_buf[0].data(), &in_len, out_left, &out_len);
-
-    in_len  = input_len;
-    out_len = output_len;
-
-    speex_resampler_process_float(
-        resampler, 1, render_buf[1].data(), &in_len, out_right, &out_len);
-
-    // Speex returns the number actually consumed and written samples in
-    // `in_len` and `out_len`, respectively. There are three outcomes:
-    //
-    // 1) The input buffer hasn't been fully consumed, but the output buffer
-    //    has been completely filled.
-    //
-    // 2) The output buffer hasn't been filled completely, but all input
-    //    samples have been consumed.
-    //
-    // 3) All input samples have been consumed and the output buffer has been
-    //    completely filled.
-    //
-    if (out_len < output_len) {
-        // Case 2: The output buffer hasn't been filled completely; we need to
-        // generate more input samples.
-        //
-        const auto num_out_frames_remaining = output_len - out_len;
-        const auto curr_out_pos             = out_len;
-
-        // "It's the only way to be sure"
-        const auto render_frame_count = static_cast<int>(std::ceil(
-            static_cast<double>(num_out_frames_remaining) * resample_ratio));
-
-        render_buf[0].clear();
-        render_buf[1].clear();
-
-        RenderAudio(render_frame_count);
-
-        in_len  = render_buf[0].size();
-        out_len = num_out_frames_remaining;
-
-        speex_resampler_process_float(resampler,
-                                      0,
-                                      render_buf[0].data(),
-                                      &in_len,
-                                      out_left + curr_out_pos,
-                                      &out_len);
-
-        in_len  = render_buf[1].size();
-        out_len = num_out_frames_remaining;
-
-        speex_resampler_process_float(resampler,
-                                      1,
-                                      render_buf[1].data(),
-                                      &in_len,
-                                      out_right + curr_out_pos,
-                                      &out_len);
-    }
-
-    if (in_len < input_len) {
-        // Case 1: The input buffer hasn't been fully consumed; we have
-        // leftover input samples that we need to keep for the next Process()
-        // call.
-        //
-        if (in_len > 0) {
-            render_buf[0].erase(render_buf[0].begin(), render_buf[0].begin() + in_len);
-            render_buf[1].erase(render_buf[1].begin(), render_buf[1].begin() + in_len);
+    uint32_t num_written = 0;
+
+    while (num_written < num_out_frames) {
+        const auto in = render_buf.PrepareContiguousRead<AudioFrame<float>>();
+
+        if (in.empty()) {
+            // The resampler consumed everything before filling the output;
+            // "It's the only way to be sure"
+            const auto render_frame_count = static_cast<uint32_t>(std::ceil(
+                static_cast<double>(num_out_frames - num_written) * resample_ratio));
+
+            RenderAudio(render_frame_count);
+            continue;
         }
 
+        // Both resamplers return the number of actually consumed and written
+        // frames in `in_len` and `out_len`, respectively. The input is read
+        // in place from the ring; whatever isn't consumed stays there for the
+        // next call.
+        spx_uint32_t in_len  = in.size();
+        spx_uint32_t out_len = num_out_frames - num_written;
+
+        if (use_polyphase_resampler) {
+            polyphase_resampler.Process(in,
+                                        in_len,
+                                        out_left + num_written,
+                                        out_right + num_written,
+                                        out_len);
+        } else {
+            // Both channels always consume and produce the same amount
+            speex_resampler_process_float(
+                resampler, 0, &in[0].left, &in_len, out_left + num_written, &out_len);
+
+            in_len  = in.size();
+            out_len = num_out_frames - num_written;
+
+            speex_resampler_process_float(
+                resampler, 1, &in[0].right, &in_len, out_right + num_written, &out_len);
+        }
+
+        render_buf.FinishContiguousRead<AudioFrame<float>>(in_len);
+        num_written += out_len;
+    }
+}
+
+void NukedSc55::RenderOutput(const uint32_t num_frames, float* out_left,
+                             float* out_right)
+{
+    if (do_resample) {
+        ResampleAndPublishFrames(num_frames, out_left, out_right);
+
     } else {
-        // Case 3: All input samples have been consumed and the output buffer
-        // has been completely filled.
-        //
-        render_buf[0].clear();
-        render_buf[1].clear();
+        assert(out_left && out_right);
+        assert(render_buf.GetReadableElements<AudioFrame<float>>() >= num_frames);
+
+        for (uint32_t i = 0; i < num_frames;) {
+            const auto in = render_buf.PrepareContiguousRead<AudioFrame<float>>();
+            const auto n  = std::min<size_t>(in.size(), num_frames - i);
+
+            for (size_t j = 0; j < n; ++j) {
+                out_left[i + j]  = in[j].left;
+                out_right[i + j] = in[j].right;
+            }
+
+            render_buf.FinishContiguousRead<AudioFrame<float>>(n);
+            i += n;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Render-ahead mode
+//
+// The worker thread renders output frames into `output_queue` up to
+// `render_ahead_end`, which Process moves forward by one block at a time
+// after queueing the block's MIDI events. The worker starts
+// `render_ahead_frames` ahead, so as long as it keeps up, the frames a block
+// needs are ready before Process asks for them.
+
+bool NukedSc55::StartRenderAhead(const uint32_t max_frame_count)
+{
+    // Everything the worker may render ahead, plus a late block waiting to
+    // be dropped
+    const auto output_queue_size =
+        std::bit_ceil(static_cast<size_t>(render_ahead_frames) +
+                      max_frame_count * 2 + 256) *
+        sizeof(AudioFrame<float>);
+
+    if (!output_queue_storage.Init(output_queue_size)) {
+        return false;
+    }
+    output_queue = RingbufferView(output_queue_storage);
+
+    num_frames_played  = 0;
+    num_frames_to_drop = 0;
+
+    // Render the lookahead up front so the worker starts out exactly
+    // `render_ahead_frames` ahead
+    uint64_t pos = 0;
+    render_ahead_quit = false;
+    RenderAheadUntil(pos, render_ahead_frames);
+
+    render_ahead_end    = pos;
+    render_ahead_thread = std::thread(&NukedSc55::RenderAheadWorker, this, pos);
+    render_ahead        = true;
+
+    return true;
+}
+
+void NukedSc55::StopRenderAhead()
+{
+    if (!render_ahead_thread.joinable()) {
+        return;
+    }
+
+    render_ahead_quit = true;
+
+    // Any change wakes the worker up
+    render_ahead_end.fetch_add(1);
+    render_ahead_end.notify_one();
+
+    render_ahead_thread.join();
+    render_ahead = false;
+}
+
+void NukedSc55::RenderAheadWorker(uint64_t pos)
+{
+    while (!render_ahead_quit) {
+        const uint64_t end = render_ahead_end.load();
+
+        if (pos >= end) {
+            render_ahead_end.wait(end);
+            continue;
+        }
+        RenderAheadUntil(pos, end);
+    }
+}
+
+void NukedSc55::RenderAheadUntil(uint64_t& pos, const uint64_t end)
+{
+    constexpr uint64_t MaxChunkFrames = 256;
+
+    std::array<float, MaxChunkFrames> left  = {};
+    std::array<float, MaxChunkFrames> right = {};
+
+    while (pos < end && !render_ahead_quit) {
+        // Only contended while the host saves or loads state
+        std::lock_guard lock(emu_mutex);
+
+        auto chunk_end = std::min(end, pos + MaxChunkFrames);
+
+        // Post the MIDI bytes that are due and stop at the next ones
+        while (midi_queue.GetReadableElements<QueuedMidi>() > 0) {
+            const auto& entry = midi_queue.PrepareContiguousRead<QueuedMidi>()[0];
+
+            if (entry.frame > pos) {
+                chunk_end = std::min(chunk_end, entry.frame);
+                break;
+            }
+            // Before the entry leaves the queue; see ProcessRenderAhead
+            ResetIdle();
+            emu->PostMIDI(std::span{entry.data, entry.size});
+
+            midi_queue.FinishContiguousRead<QueuedMidi>(1);
+        }
+
+        const auto num_frames = static_cast<uint32_t>(chunk_end - pos);
+
+        RenderAudio(static_cast<uint32_t>(
+            static_cast<double>(num_frames) * resample_ratio));
+
+        RenderOutput(num_frames, left.data(), right.data());
+
+        // The queue is sized in StartRenderAhead so that it never fills up
+        assert(output_queue.GetWritableElements<AudioFrame<float>>() >= num_frames);
+
+        for (uint32_t i = 0; i < num_frames;) {
+            const auto dest = output_queue.PrepareContiguousWrite<AudioFrame<float>>();
+            const auto n    = std::min<size_t>(dest.size(), num_frames - i);
+
+            for (size_t j = 0; j < n; ++j) {
+                dest[j].left  = left[i + j];
+                dest[j].right = right[i + j];
+            }
+
+            output_queue.FinishContiguousWrite<AudioFrame<float>>(n);
+            i += n;
+        }
+
+        pos = chunk_end;
+    }
+}
+
+clap_process_status NukedSc55::ProcessRenderAhead(const clap_process_t* process)
+{
+    assert(process->audio_outputs_count == 1);
+    assert(process->audio_inputs_count == 0);
+
+    const uint32_t num_frames = process->frames_count;
+    const uint32_t num_events = process->in_events->size(process->in_events);
+
+    // Events take effect `render_ahead_frames` later than the host asked
+    // for; that's what the reported latency compensates for
+    const uint64_t block_start = num_frames_played + render_ahead_frames;
+
+    for (uint32_t event_index = 0; event_index < num_events; ++event_index) {
+        const auto event = process->in_events->get(process->in_events,
+                                                   event_index);
+
+        ProcessEvent(event, block_start + event->time);
+    }
+
+    render_ahead_end.store(block_start + num_frames);
+    render_ahead_end.notify_one();
+
+    auto out_left  = process->audio_outputs[0].data32[0];
+    auto out_right = process->audio_outputs[0].data32[1];
+
+    while (num_frames_to_drop > 0) {
+        const auto in = output_queue.PrepareContiguousRead<AudioFrame<float>>();
+        if (in.empty()) {
+            break;
+        }
+
+        const auto n = std::min<uint64_t>(in.size(), num_frames_to_drop);
+        output_queue.FinishContiguousRead<AudioFrame<float>>(n);
+
+        num_frames_to_drop -= n;
+    }
+
+    uint32_t num_copied = 0;
+
+    while (num_frames_to_drop == 0 && num_copied < num_frames) {
+        const auto in = output_queue.PrepareContiguousRead<AudioFrame<float>>();
+        if (in.empty()) {
+            break;
+        }
+
+        const auto n = std::min<size_t>(in.size(), num_frames - num_copied);
+
+        for (size_t j = 0; j < n; ++j) {
+            out_left[num_copied + j]  = in[j].left;
+            out_right[num_copied + j] = in[j].right;
+        }
+
+        output_queue.FinishContiguousRead<AudioFrame<float>>(n);
+        num_copied += n;
+    }
+
+    if (num_copied < num_frames) {
+        // The worker fell behind
+        log("Render-ahead underrun: %d frames", num_frames - num_copied);
+
+        std::fill(out_left + num_copied, out_left + num_frames, 0.0f);
+        std::fill(out_right + num_copied, out_right + num_frames, 0.0f);
+
+        num_frames_to_drop += num_frames - num_copied;
+    }
+
+    num_frames_played += num_frames;
+
+    // The worker resets `idle` before it takes MIDI off the queue, so only
+    // trust it and the tail once the queue is empty. The queued output
+    // frames were all rendered after the output went quiet.
+    if (midi_queue.GetReadableElements<QueuedMidi>() > 0) {
+        return CLAP_PROCESS_CONTINUE;
     }
+    return GetProcessStatus();
 }
@@ -1,21 +1,38 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "clap/clap.h"
 #include "nuked-sc55/backend/emu.h"
+#include "nuked-sc55/backend/ringbuffer.h"
+#include "resampler.h"
 #include "speex/speex_resampler.h"
 
 class NukedSc55 {
 public:
     enum class Model { Sc55_v1_00, Sc55_v1_20, Sc55_v1_21, Sc55_v2_00, Sc55mk2_v1_01 };
 
+    // Settings that are fixed for the lifetime of an instance
+    struct Options {
+        // Quality of the built-in resampler; Speex is always used at its
+        // desktop quality
+        PolyphaseResampler::Quality resample_quality = PolyphaseResampler::Quality::Medium;
+
+        // If non-zero, render this many output frames ahead of the host on
+        // a worker thread (see `render_ahead_frames` below)
+        uint32_t render_ahead_frames = 0;
+    };
+
     // Init/shutdown
     NukedSc55(const clap_plugin_t plugin_class, const clap_host_t* host,
-              const Model model);
+              const Model model, const Options& options);
 
     const clap_plugin_t* GetPluginClass();
 
@@ -24,14 +41,21 @@ public:
 
     bool Activate(const double sample_rate, const uint32_t min_frame_count,
                   const uint32_t max_frame_count);
+    void Deactivate();
+
+    uint32_t GetLatency() const;
+
+    // Output frames until the sound has died out, or InfiniteTail while
+    // any voice is playing
+    uint32_t GetTail() const;
+
+    static constexpr uint32_t InfiniteTail = INT32_MAX;
 
     // Processing
     clap_process_status Process(const clap_process_t* process);
 
     void Flush(const clap_input_events_t* in, const clap_output_events_t* out);
 
-    void PublishFrame(const float left, const float right);
-
     // State handling
     bool LoadState(const clap_istream_t* stream);
     bool SaveState(const clap_ostream_t* stream);
@@ -45,24 +69,149 @@ private:
     const clap_host_t* host            = nullptr;
     const clap_plugin* plugin_instance = nullptr;
 
+    const clap_host_tail_t* host_tail = nullptr;
+
     std::unique_ptr<Emulator> emu = nullptr;
 
+    // Identifies the post-boot emulator state for the loaded ROMs and plugin
+    // version (see RestoreBootState)
+    std::string boot_state_key            = {};
+    std::filesystem::path boot_state_path = {};
+
+    // Set once the emulator has booted or a state has been loaded into it;
+    // Activate only boots it before that
+    bool has_emu_state = false;
+
+    // Guards the emulator against state save/load racing with processing
+    std::mutex emu_mutex = {};
+
+    // Serialised emulator states; reused between LoadState and SaveState
+    // calls respectively. Only accessed outside of `emu_mutex`.
+    std::vector<uint8_t> load_state_buf = {};
+    std::vector<uint8_t> save_state_buf = {};
+
     double render_sample_rate_hz = 0.0;
     double output_sample_rate_hz = 0.0;
 
-    std::array<std::vector<float>, 2> render_buf = {};
+    // Rendered frames waiting to be resampled or copied to the output.
+    // Sized in Activate so that rendering never has to grow it.
+    GenericBuffer render_buf_storage = {};
+    RingbufferView render_buf        = {};
+
+    // The emulator writes frames here (see Emulator::SetSampleSink) before
+    // they are converted to float and moved to `render_buf`
+    std::array<AudioFrame<int32_t>, 256> sink_buf = {};
+
+    // The built-in polyphase resampler handles the common host rates; Speex
+    // is the fallback for everything else
+    PolyphaseResampler polyphase_resampler       = {};
+    PolyphaseResampler::Quality resample_quality = PolyphaseResampler::Quality::Medium;
+    bool use_polyphase_resampler                 = false;
 
     SpeexResamplerState* resampler = nullptr;
     bool do_resample               = false;
     double resample_ratio          = 0.0f;
 
+    // Silence detection. Once no voice has played and the output has stayed
+    // quiet for `min_idle_frames` rendered frames, and the reverb and chorus
+    // have died out, the emulator is idle: its state no longer changes in
+    // any way that matters until the next MIDI message. Blocks without
+    // events then skip emulation entirely, and Process asks the host to put
+    // the plugin to sleep. Updated by whoever renders (the worker in
+    // render-ahead mode).
+    uint64_t num_quiet_frames = 0;
+    uint64_t min_idle_frames  = 0;
+    std::atomic<bool> idle    = false;
+
+    // Tail estimate in output frames (see UpdateTail). Once no voice is
+    // playing, the residual level is measured every so often; the drop
+    // between two measurements gives the decay rate, from which the time
+    // left until it's below the quiet level follows.
+    std::atomic<uint32_t> tail_frames = InfiniteTail;
+    std::atomic<bool> tail_changed    = false;
+
+    // `tail_level` is only valid once `tail_level_measured` is set; a
+    // measurement of exactly zero is a valid one
+    double tail_level        = 0.0;
+    uint64_t tail_level_age  = 0;
+    bool tail_level_measured = false;
+    double tail_decay_frames = 0.0;
+
+    // Render-ahead mode: if non-zero, the emulator runs on a worker thread
+    // this many output frames ahead of the host, so the odd expensive block
+    // is absorbed instead of causing a dropout. Reported as latency.
+    uint32_t render_ahead_frames = 0;
+    bool render_ahead            = false;
+
+    // MIDI bytes queued by the audio thread for the worker, or, outside of
+    // render-ahead mode, held back while the emulator is locked (see
+    // DeferEvents). SysEx messages are split over as many entries as needed.
+    struct QueuedMidi {
+        // Output frame the bytes take effect at
+        uint64_t frame;
+
+        uint8_t size;
+        uint8_t data[7];
+    };
+
+    GenericBuffer midi_queue_storage = {};
+    RingbufferView midi_queue        = {};
+
+    // Set while DeferEvents queues MIDI instead of posting it
+    bool defer_midi = false;
+
+    // Output frames rendered by the worker, waiting to be played
+    GenericBuffer output_queue_storage = {};
+    RingbufferView output_queue        = {};
+
+    std::thread render_ahead_thread        = {};
+    std::atomic<bool> render_ahead_quit    = false;
+    std::atomic<uint64_t> render_ahead_end = 0;
+
+    // Only touched by the audio thread. Frames the worker delivered too late
+    // were played as silence; they are dropped when they arrive so the
+    // latency stays constant.
+    uint64_t num_frames_played  = 0;
+    uint64_t num_frames_to_drop = 0;
+
     // Methods
     std::filesystem::path GetRomBasePath();
 
-    void ProcessEvent(const clap_event_header_t* event);
+    void ProcessEvent(const clap_event_header_t* event, const uint64_t frame = 0);
+
+    void PostMidi(const uint64_t frame, std::span<const uint8_t> bytes);
+
+    // Queue the MIDI events in `in` while another thread holds `emu_mutex`,
+    // and post them once the lock is taken again
+    void DeferEvents(const clap_input_events_t* in);
+    void PostDeferredMidi();
+
+    bool RestoreBootState();
+    void StoreBootState();
 
     void RenderAudio(const uint32_t num_frames);
 
+    void PublishFrames(std::span<const AudioFrame<int32_t>> frames);
+
+    void UpdateIdle(std::span<const AudioFrame<int32_t>> frames);
+    void ResetIdle();
+
+    void UpdateTail(const size_t num_frames);
+    void SetTail(const uint32_t num_frames);
+
+    clap_process_status GetProcessStatus();
+
     void ResampleAndPublishFrames(const uint32_t num_out_frames,
                                   float* out_left, float* out_right);
+
+    void RenderOutput(const uint32_t num_frames, float* out_left, float* out_right);
+
+    // Render-ahead mode
+    bool StartRenderAhead(const uint32_t max_frame_count);
+    void StopRenderAhead();
+
+    void RenderAheadWorker(uint64_t pos);
+    void RenderAheadUntil(uint64_t& pos, const uint64_t end);
+
+    clap_process_status ProcessRenderAhead(const clap_process_t* process);
 };
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 
@@ -140,6 +142,18 @@ static const clap_plugin_state_t extension_state = {
         return the_plugin->LoadState(stream);
     }};
 
+static const clap_plugin_latency_t extension_latency = {
+    .get = [](const clap_plugin_t* plugin) -> uint32_t {
+        auto the_plugin = (NukedSc55*)plugin->plugin_data;
+        return the_plugin->GetLatency();
+    }};
+
+static const clap_plugin_tail_t extension_tail = {
+    .get = [](const clap_plugin_t* plugin) -> uint32_t {
+        auto the_plugin = (NukedSc55*)plugin->plugin_data;
+        return the_plugin->GetTail();
+    }};
+
 //////////////////////////////////////////////////////////////////////////////
 // Plugin classes
 //////////////////////////////////////////////////////////////////////////////
@@ -155,6 +169,12 @@ static const void* get_extension(const clap_plugin* plugin, const char* id)
     } else if (strcmp(id, CLAP_EXT_STATE) == 0) {
         return &extension_state;
 
+    } else if (strcmp(id, CLAP_EXT_LATENCY) == 0) {
+        return &extension_latency;
+
+    } else if (strcmp(id, CLAP_EXT_TAIL) == 0) {
+        return &extension_tail;
+
     } else {
         return nullptr;
     }
@@ -187,7 +207,10 @@ static const clap_plugin_t my_plugin_class_sc55_v1_00 = {
         return the_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
     },
 
-    .deactivate = [](const clap_plugin* plugin) {},
+    .deactivate = [](const clap_plugin* plugin) {
+        auto the_plugin = (NukedSc55*)plugin->plugin_data;
+        the_plugin->Deactivate();
+    },
 
     .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
 
@@ -234,7 +257,10 @@ static const clap_plugin_t my_plugin_class_sc55_v1_20 = {
         return the_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
     },
 
-    .deactivate = [](const clap_plugin* plugin) {},
+    .deactivate = [](const clap_plugin* plugin) {
+        auto the_plugin = (NukedSc55*)plugin->plugin_data;
+        the_plugin->Deactivate();
+    },
 
     .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
 
@@ -281,7 +307,10 @@ static const clap_plugin_t my_plugin_class_sc55_v1_21 = {
         return the_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
     },
 
-    .deactivate = [](const clap_plugin* plugin) {},
+    .deactivate = [](const clap_plugin* plugin) {
+        auto the_plugin = (NukedSc55*)plugin->plugin_data;
+        the_plugin->Deactivate();
+    },
 
     .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
 
@@ -328,7 +357,10 @@ static const clap_plugin_t my_plugin_class_sc55_v2_00 = {
         return the_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
     },
 
-    .deactivate = [](const clap_plugin* plugin) {},
+    .deactivate = [](const clap_plugin* plugin) {
+        auto the_plugin = (NukedSc55*)plugin->plugin_data;
+        the_plugin->Deactivate();
+    },
 
     .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
 
@@ -375,7 +407,10 @@ static const clap_plugin_t my_plugin_class_sc55mk2_v1_01 = {
         return the_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
     },
 
-    .deactivate = [](const clap_plugin* plugin) {},
+    .deactivate = [](const clap_plugin* plugin) {
+        auto the_plugin = (NukedSc55*)plugin->plugin_data;
+        the_plugin->Deactivate();
+    },
 
     .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
 
@@ -395,6 +430,38 @@ static const clap_plugin_t my_plugin_class_sc55mk2_v1_01 = {
 
     .on_main_thread = [](const clap_plugin* plugin) {}};
 
+//////////////////////////////////////////////////////////////////////////////
+// Plugin options
+//////////////////////////////////////////////////////////////////////////////
+
+// There's no GUI to change these from, so they're read from environment
+// variables when an instance is created (see README.md)
+static NukedSc55::Options get_plugin_options()
+{
+    NukedSc55::Options options = {};
+
+    if (const char* quality = getenv("NUKED_SC55_RESAMPLE_QUALITY")) {
+        if (strcmp(quality, "low") == 0) {
+            options.resample_quality = PolyphaseResampler::Quality::Low;
+
+        } else if (strcmp(quality, "medium") == 0) {
+            options.resample_quality = PolyphaseResampler::Quality::Medium;
+
+        } else if (strcmp(quality, "high") == 0) {
+            options.resample_quality = PolyphaseResampler::Quality::High;
+        }
+    }
+
+    if (const char* frames = getenv("NUKED_SC55_RENDER_AHEAD_FRAMES")) {
+        // Keeps the output queue to a sensible size
+        constexpr unsigned long MaxRenderAheadFrames = 65536;
+
+        options.render_ahead_frames = static_cast<uint32_t>(
+            std::min(strtoul(frames, nullptr, 10), MaxRenderAheadFrames));
+    }
+    return options;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Plugin factory
 //////////////////////////////////////////////////////////////////////////////
@@ -433,32 +500,39 @@ static const clap_plugin_factory_t plugin_factory = {
             return nullptr;
         }
 
+        const auto options = get_plugin_options();
+
         NukedSc55* the_plugin = nullptr;
 
         if (strcmp(plugin_id, plugin_descriptor_sc55_v1_00.id) == 0) {
             the_plugin = new NukedSc55(my_plugin_class_sc55_v1_00,
                                        host,
-                                       NukedSc55::Model::Sc55_v1_00);
+                                       NukedSc55::Model::Sc55_v1_00,
+                                       options);
 
         } else if (strcmp(plugin_id, plugin_descriptor_sc55_v1_20.id) == 0) {
             the_plugin = new NukedSc55(my_plugin_class_sc55_v1_20,
                                        host,
-                                       NukedSc55::Model::Sc55_v1_20);
+                                       NukedSc55::Model::Sc55_v1_20,
+                                       options);
 
         } else if (strcmp(plugin_id, plugin_descriptor_sc55_v1_21.id) == 0) {
             the_plugin = new NukedSc55(my_plugin_class_sc55_v1_21,
                                        host,
-                                       NukedSc55::Model::Sc55_v1_21);
+                                       NukedSc55::Model::Sc55_v1_21,
+                                       options);
 
         } else if (strcmp(plugin_id, plugin_descriptor_sc55_v2_00.id) == 0) {
             the_plugin = new NukedSc55(my_plugin_class_sc55_v2_00,
                                        host,
-                                       NukedSc55::Model::Sc55_v2_00);
+                                       NukedSc55::Model::Sc55_v2_00,
+                                       options);
 
         } else if (strcmp(plugin_id, plugin_descriptor_sc55mk2_v1_01.id) == 0) {
             the_plugin = new NukedSc55(my_plugin_class_sc55mk2_v1_01,
                                        host,
-                                       NukedSc55::Model::Sc55mk2_v1_01);
+                                       NukedSc55::Model::Sc55mk2_v1_01,
+                                       options);
         } else {
             return nullptr;
         }
@@ -471,6 +545,7 @@ static const clap_plugin_factory_t plugin_factory = {
 //////////////////////////////////////////////////////////////////////////////
 
 std::string plugin_path = {};
+const char* plugin_version = Version;
 
 extern "C" const clap_plugin_entry_t clap_entry = {
     .clap_version = CLAP_VERSION_INIT,
@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <numbers>
+#include <numeric>
+
+#include "resampler.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RESAMPLER_HAVE_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define RESAMPLER_AVX2_TARGET
+#else
+#define RESAMPLER_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+// NEON is part of the baseline on 64-bit ARM, so it needs no runtime check
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define RESAMPLER_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+// Ratios with more phases than this interpolate between InterpolatedPhases
+// fixed ones instead
+constexpr uint32_t MaxExactPhases     = 1024;
+constexpr uint32_t InterpolatedPhases = 256;
+
+// Frames copied into the history per round in Process
+constexpr size_t HistoryChunkFrames = 256;
+
+struct QualityParams {
+    uint32_t num_taps;
+
+    // Cutoff as a fraction of the input Nyquist frequency, and the Kaiser
+    // window's beta (higher means more stopband attenuation but a wider
+    // transition band)
+    double cutoff;
+    double beta;
+};
+
+static QualityParams GetQualityParams(const PolyphaseResampler::Quality quality)
+{
+    switch (quality) {
+    case PolyphaseResampler::Quality::Low: return {32, 0.85, 7.0};
+    case PolyphaseResampler::Quality::Medium: return {64, 0.90, 8.0};
+    case PolyphaseResampler::Quality::High: return {128, 0.94, 10.0};
+    }
+    return {32, 0.85, 7.0};
+}
+
+struct PolyphaseResampler::FilterBank {
+    Quality quality     = {};
+    bool interpolated   = false;
+    uint32_t num_phases = 0;
+    uint32_t num_taps   = 0;
+
+    // One row of `num_taps` coefficients per phase, plus a closing row at a
+    // phase of 1.0 when interpolating. Every coefficient is stored twice so
+    // that rows line up with interleaved stereo frames.
+    std::vector<float> coeffs = {};
+
+    const float* GetRow(const uint32_t row) const
+    {
+        return coeffs.data() + static_cast<size_t>(row) * num_taps * 2;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Filter design
+
+// Zeroth order modified Bessel function of the first kind
+static double BesselI0(const double x)
+{
+    double sum  = 1.0;
+    double term = 1.0;
+
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Fills `row` with the Kaiser windowed sinc taps for an output frame
+// `frac` input frames after the centre tap
+static void DesignRow(const QualityParams& params, const double frac, float* row)
+{
+    const double half   = params.num_taps / 2.0;
+    const double centre = half - 1.0;
+
+    std::vector<double> taps(params.num_taps);
+    double sum = 0.0;
+
+    for (uint32_t k = 0; k < params.num_taps; ++k) {
+        const double t = frac + centre - k;
+        const double x = t / half;
+
+        double w = 0.0;
+        if (x > -1.0 && x < 1.0) {
+            w = BesselI0(params.beta * std::sqrt(1.0 - x * x)) /
+                BesselI0(params.beta);
+        }
+
+        const double arg  = std::numbers::pi * params.cutoff * t;
+        const double sinc = (t == 0.0) ? 1.0 : std::sin(arg) / arg;
+
+        taps[k] = params.cutoff * sinc * w;
+        sum += taps[k];
+    }
+
+    // Unity gain at DC for every phase, otherwise the phases' slightly
+    // different gains modulate low-frequency content
+    for (uint32_t k = 0; k < params.num_taps; ++k) {
+        const auto c   = static_cast<float>(taps[k] / sum);
+        row[k * 2]     = c;
+        row[k * 2 + 1] = c;
+    }
+}
+
+static std::shared_ptr<PolyphaseResampler::FilterBank> CreateFilterBank(
+    const PolyphaseResampler::Quality quality, const bool interpolated,
+    const uint32_t num_phases)
+{
+    const auto params = GetQualityParams(quality);
+
+    auto bank          = std::make_shared<PolyphaseResampler::FilterBank>();
+    bank->quality      = quality;
+    bank->interpolated = interpolated;
+    bank->num_phases   = num_phases;
+    bank->num_taps     = params.num_taps;
+
+    const uint32_t num_rows = interpolated ? num_phases + 1 : num_phases;
+    bank->coeffs.resize(static_cast<size_t>(num_rows) * params.num_taps * 2);
+
+    for (uint32_t row = 0; row < num_rows; ++row) {
+        DesignRow(params,
+                  static_cast<double>(row) / num_phases,
+                  bank->coeffs.data() + static_cast<size_t>(row) * params.num_taps * 2);
+    }
+    return bank;
+}
+
+static std::mutex filter_banks_mutex;
+static std::vector<std::weak_ptr<const PolyphaseResampler::FilterBank>> filter_banks;
+
+// Banks are shared by all instances running at the same ratio and quality
+static std::shared_ptr<const PolyphaseResampler::FilterBank> AcquireFilterBank(
+    const PolyphaseResampler::Quality quality, const bool interpolated,
+    const uint32_t num_phases)
+{
+    std::scoped_lock lock(filter_banks_mutex);
+
+    for (size_t i = 0; i < filter_banks.size();) {
+        auto bank = filter_banks[i].lock();
+        if (!bank) {
+            filter_banks[i] = std::move(filter_banks.back());
+            filter_banks.pop_back();
+            continue;
+        }
+        if (bank->quality == quality && bank->interpolated == interpolated &&
+            bank->num_phases == num_phases) {
+            return bank;
+        }
+        ++i;
+    }
+
+    std::shared_ptr<const PolyphaseResampler::FilterBank> bank =
+        CreateFilterBank(quality, interpolated, num_phases);
+
+    filter_banks.push_back(bank);
+    return bank;
+}
+
+//----------------------------------------------------------------------------
+// Convolution kernels
+//
+// Each one filters `num_taps` interleaved stereo frames starting at `in`
+// with a row of doubled coefficients and writes the left and right results
+// to `out`. The interpolating variants also filter with `row1` and blend the
+// two results by `frac`. `num_taps` is always a multiple of 8.
+
+using ConvolveFunc = void (*)(const float* in, const float* row0,
+                              const float* row1, const float frac,
+                              const uint32_t num_taps, float* out);
+
+template <bool Interpolate>
+static void ConvolvePortable(const float* in, const float* row0,
+                             const float* row1, const float frac,
+                             const uint32_t num_taps, float* out)
+{
+    float acc0[2] = {};
+    float acc1[2] = {};
+
+    for (uint32_t i = 0; i < num_taps * 2; i += 2) {
+        acc0[0] += in[i] * row0[i];
+        acc0[1] += in[i + 1] * row0[i + 1];
+
+        if constexpr (Interpolate) {
+            acc1[0] += in[i] * row1[i];
+            acc1[1] += in[i + 1] * row1[i + 1];
+        }
+    }
+    if constexpr (Interpolate) {
+        acc0[0] += frac * (acc1[0] - acc0[0]);
+        acc0[1] += frac * (acc1[1] - acc0[1]);
+    }
+    out[0] = acc0[0];
+    out[1] = acc0[1];
+}
+
+#ifdef RESAMPLER_HAVE_AVX2
+template <bool Interpolate>
+RESAMPLER_AVX2_TARGET static void ConvolveAVX2(const float* in, const float* row0,
+                                               const float* row1, const float frac,
+                                               const uint32_t num_taps, float* out)
+{
+    // Lanes alternate between left and right. Two accumulators per row hide
+    // the FMA latency.
+    __m256 acc0a = _mm256_setzero_ps();
+    __m256 acc0b = _mm256_setzero_ps();
+    __m256 acc1a = _mm256_setzero_ps();
+    __m256 acc1b = _mm256_setzero_ps();
+
+    for (uint32_t i = 0; i < num_taps * 2; i += 16) {
+        const __m256 xa = _mm256_loadu_ps(in + i);
+        const __m256 xb = _mm256_loadu_ps(in + i + 8);
+
+        acc0a = _mm256_fmadd_ps(xa, _mm256_loadu_ps(row0 + i), acc0a);
+        acc0b = _mm256_fmadd_ps(xb, _mm256_loadu_ps(row0 + i + 8), acc0b);
+
+        if constexpr (Interpolate) {
+            acc1a = _mm256_fmadd_ps(xa, _mm256_loadu_ps(row1 + i), acc1a);
+            acc1b = _mm256_fmadd_ps(xb, _mm256_loadu_ps(row1 + i + 8), acc1b);
+        }
+    }
+
+    __m256 acc = _mm256_add_ps(acc0a, acc0b);
+    if constexpr (Interpolate) {
+        const __m256 acc1 = _mm256_add_ps(acc1a, acc1b);
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(frac), _mm256_sub_ps(acc1, acc), acc);
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+                            _mm256_extractf128_ps(acc, 1));
+    sum        = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+
+    _mm_storel_pi(reinterpret_cast<__m64*>(out), sum);
+}
+
+static bool HaveAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    // AVX2 in leaf 7 EBX; FMA, AVX and OSXSAVE in leaf 1 ECX, and the OS
+    // must save the YMM registers
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+        return false;
+    }
+    __cpuid(regs, 1);
+    constexpr int Leaf1Bits = (1 << 12) | (1 << 27) | (1 << 28);
+    if ((regs[2] & Leaf1Bits) != Leaf1Bits || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
+
+#ifdef RESAMPLER_HAVE_NEON
+template <bool Interpolate>
+static void ConvolveNEON(const float* in, const float* row0, const float* row1,
+                         const float frac, const uint32_t num_taps, float* out)
+{
+    float32x4_t acc0a = vdupq_n_f32(0.0f);
+    float32x4_t acc0b = vdupq_n_f32(0.0f);
+    float32x4_t acc1a = vdupq_n_f32(0.0f);
+    float32x4_t acc1b = vdupq_n_f32(0.0f);
+
+    for (uint32_t i = 0; i < num_taps * 2; i += 8) {
+        const float32x4_t xa = vld1q_f32(in + i);
+        const float32x4_t xb = vld1q_f32(in + i + 4);
+
+        acc0a = vfmaq_f32(acc0a, xa, vld1q_f32(row0 + i));
+        acc0b = vfmaq_f32(acc0b, xb, vld1q_f32(row0 + i + 4));
+
+        if constexpr (Interpolate) {
+            acc1a = vfmaq_f32(acc1a, xa, vld1q_f32(row1 + i));
+            acc1b = vfmaq_f32(acc1b, xb, vld1q_f32(row1 + i + 4));
+        }
+    }
+
+    float32x4_t acc = vaddq_f32(acc0a, acc0b);
+    if constexpr (Interpolate) {
+        const float32x4_t acc1 = vaddq_f32(acc1a, acc1b);
+        acc = vfmaq_n_f32(acc, vsubq_f32(acc1, acc), frac);
+    }
+
+    vst1_f32(out, vadd_f32(vget_low_f32(acc), vget_high_f32(acc)));
+}
+#endif
+
+static ConvolveFunc SelectConvolve(const bool interpolated)
+{
+#ifdef RESAMPLER_HAVE_AVX2
+    if (HaveAVX2()) {
+        return interpolated ? ConvolveAVX2<true> : ConvolveAVX2<false>;
+    }
+#endif
+#ifdef RESAMPLER_HAVE_NEON
+    return interpolated ? ConvolveNEON<true> : ConvolveNEON<false>;
+#else
+    return interpolated ? ConvolvePortable<true> : ConvolvePortable<false>;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// PolyphaseResampler
+
+bool PolyphaseResampler::IsSupported(const uint32_t in_rate_hz,
+                                     const uint32_t out_rate_hz)
+{
+    // Downsampling would need the cutoff to follow the output rate, and the
+    // emulator never runs above these anyway
+    constexpr uint32_t HostRates[] = {44100, 48000, 88200, 96000};
+
+    return in_rate_hz > 0 && out_rate_hz > in_rate_hz &&
+           std::find(std::begin(HostRates), std::end(HostRates), out_rate_hz) !=
+               std::end(HostRates);
+}
+
+bool PolyphaseResampler::Init(const uint32_t in_rate_hz,
+                              const uint32_t out_rate_hz, const Quality quality)
+{
+    if (!IsSupported(in_rate_hz, out_rate_hz)) {
+        return false;
+    }
+
+    const uint32_t gcd = std::gcd(in_rate_hz, out_rate_hz);
+    num_phases         = out_rate_hz / gcd;
+    step               = in_rate_hz / gcd;
+
+    const bool interpolated = (num_phases > MaxExactPhases);
+
+    bank = AcquireFilterBank(quality,
+                             interpolated,
+                             interpolated ? InterpolatedPhases : num_phases);
+
+    const uint32_t num_taps = bank->num_taps;
+
+    history.assign((num_taps + HistoryChunkFrames) * 2, 0.0f);
+
+    // Start with enough silence before the first input frame that it's the
+    // centre tap of the first output frame's window, so the output isn't
+    // delayed
+    history_len = num_taps / 2 - 1;
+    pos         = 0;
+    phase       = 0;
+
+    return true;
+}
+
+void PolyphaseResampler::Process(std::span<const AudioFrame<float>> in,
+                                 uint32_t& in_len, float* out_left,
+                                 float* out_right, uint32_t& out_len)
+{
+    static const ConvolveFunc convolve        = SelectConvolve(false);
+    static const ConvolveFunc convolve_interp = SelectConvolve(true);
+
+    static_assert(sizeof(AudioFrame<float>) == 2 * sizeof(float));
+    assert(in.size() >= in_len);
+
+    const uint32_t num_taps = bank->num_taps;
+    const size_t capacity   = history.size() / 2;
+
+    uint32_t num_read    = 0;
+    uint32_t num_written = 0;
+
+    for (;;) {
+        const size_t num_copied = std::min<size_t>(in_len - num_read,
+                                                   capacity - history_len);
+
+        std::memcpy(history.data() + history_len * 2,
+                    in.data() + num_read,
+                    num_copied * sizeof(AudioFrame<float>));
+
+        history_len += num_copied;
+        num_read += num_copied;
+
+        while (num_written < out_len && pos + num_taps <= history_len) {
+            const float* window = history.data() + pos * 2;
+            float frame[2];
+
+            if (bank->interpolated) {
+                const uint64_t x = static_cast<uint64_t>(phase) * InterpolatedPhases;
+                const auto row   = static_cast<uint32_t>(x / num_phases);
+                const auto frac  = static_cast<float>(x % num_phases) /
+                                  static_cast<float>(num_phases);
+
+                convolve_interp(window, bank->GetRow(row), bank->GetRow(row + 1),
+                                frac, num_taps, frame);
+            } else {
+                convolve(window, bank->GetRow(phase), nullptr, 0.0f, num_taps, frame);
+            }
+
+            out_left[num_written]  = frame[0];
+            out_right[num_written] = frame[1];
+            ++num_written;
+
+            phase += step;
+            pos += phase / num_phases;
+            phase %= num_phases;
+        }
+
+        // Drop the frames no window needs any more
+        if (pos > 0) {
+            std::memmove(history.data(),
+                         history.data() + pos * 2,
+                         (history_len - pos) * 2 * sizeof(float));
+            history_len -= pos;
+            pos = 0;
+        }
+
+        if (num_written == out_len || num_read == in_len) {
+            break;
+        }
+    }
+
+    in_len  = num_read;
+    out_len = num_written;
+}
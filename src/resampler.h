@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "nuked-sc55/backend/audio.h"
+
+// Polyphase FIR resampler for upsampling the emulator's native output rate to
+// the usual host rates. Reads interleaved stereo frames and writes planar
+// output, filtering both channels in the same pass.
+//
+// Ratios that reduce to a small number of phases (e.g. 32000 -> 48000 Hz is
+// 3/2) use one exact filter per output phase. Others (e.g. 33103 -> 44100 Hz)
+// interpolate linearly between the two nearest of a fixed set of phases.
+//
+// Rates IsSupported() rejects should go through Speex instead.
+class PolyphaseResampler {
+public:
+    // Number of filter taps per phase: 32, 64 and 128, respectively
+    enum class Quality { Low, Medium, High };
+
+    static bool IsSupported(const uint32_t in_rate_hz, const uint32_t out_rate_hz);
+
+    bool Init(const uint32_t in_rate_hz, const uint32_t out_rate_hz,
+              const Quality quality);
+
+    // Same contract as speex_resampler_process_float: on entry `in_len` and
+    // `out_len` are the number of available input and output frames; on
+    // return they are the number of frames consumed and written. Input that
+    // isn't consumed must be passed in again on the next call.
+    void Process(std::span<const AudioFrame<float>> in, uint32_t& in_len,
+                 float* out_left, float* out_right, uint32_t& out_len);
+
+    struct FilterBank;
+
+private:
+    std::shared_ptr<const FilterBank> bank = nullptr;
+
+    // Input time advances by `step / num_phases` frames per output frame
+    uint32_t num_phases = 0;
+    uint32_t step       = 0;
+
+    // Position of the next output frame: `pos + phase / num_phases` frames
+    // after the start of `history`
+    size_t pos     = 0;
+    uint32_t phase = 0;
+
+    // Interleaved input frames; the filter needs contiguous windows of them
+    std::vector<float> history = {};
+    size_t history_len         = 0;
+};
@@ -0,0 +1,156 @@
+// Counts L1 data cache and data TLB misses per MCU step while the emulator runs on synthetic roms, with and without
+// huge pages for the waveroms (EMU_Options::huge_pages). Uses perf_event_open, so the counters are only available on
+// Linux and where perf_event_paranoid allows them; elsewhere only the time is reported. Not run as a test.
+#include "synthetic_run.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct Counter
+{
+    const char* name;
+    uint32_t    type;
+    uint64_t    config;
+    int         fd = -1;
+};
+
+#if defined(__linux__)
+static constexpr uint64_t CacheEvent(uint64_t cache, uint64_t op, uint64_t result)
+{
+    return cache | (op << 8) | (result << 16);
+}
+
+static Counter COUNTERS[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1D read misses",
+     PERF_TYPE_HW_CACHE,
+     CacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dTLB read misses",
+     PERF_TYPE_HW_CACHE,
+     CacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+};
+
+static void OpenCounters()
+{
+    for (Counter& counter : COUNTERS)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = counter.type;
+        attr.config = counter.config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counter.fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void StartCounters()
+{
+    for (Counter& counter : COUNTERS)
+    {
+        if (counter.fd >= 0)
+        {
+            ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void StopCounters(uint64_t num_steps)
+{
+    for (Counter& counter : COUNTERS)
+    {
+        uint64_t value = 0;
+        if (counter.fd < 0 || ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0) != 0 ||
+            read(counter.fd, &value, sizeof(value)) != sizeof(value))
+        {
+            printf("    %-17s n/a\n", counter.name);
+            continue;
+        }
+        printf("    %-17s %8.3f per step\n", counter.name, (double)value / (double)num_steps);
+    }
+}
+#else
+static void OpenCounters()
+{
+}
+
+static void StartCounters()
+{
+}
+
+static void StopCounters(uint64_t)
+{
+    printf("    performance counters not available on this platform\n");
+}
+#endif
+
+static void DiscardFrame(void*, const AudioFrame<int32_t>&)
+{
+}
+
+int main(int argc, char** argv)
+{
+    const uint64_t num_steps = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000000;
+
+    OpenCounters();
+
+    const Romset romsets[] = {Romset::MK2, Romset::MK1, Romset::JV880};
+
+    for (Romset romset : romsets)
+    {
+        for (int huge_pages = 0; huge_pages < 2; huge_pages++)
+        {
+            // Stays awake for the whole run, see mcu_bench
+            const TestCase test = {romset, 7, TestRom::RANDOM};
+
+            RomsetInfo roms{};
+            MakeRoms(roms, test);
+
+            AllRomsetInfo all_info{};
+            all_info.romsets[(size_t)romset] = roms;
+
+            EMU_Options options{};
+            options.huge_pages = huge_pages != 0;
+
+            Emulator emu;
+            if (!emu.Init(options) || !emu.LoadRoms(romset, all_info))
+            {
+                fprintf(stderr, "%s: could not load roms\n", RomsetName(romset));
+                return 1;
+            }
+            emu.Reset();
+            emu.SetSampleCallback(DiscardFrame, nullptr);
+
+            // Warm up the caches and the page mappings
+            for (int i = 0; i < 100000; i++)
+            {
+                emu.Step();
+            }
+
+            StartCounters();
+            const auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < num_steps; i++)
+            {
+                emu.Step();
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            printf("%s, %s: %.1f ns per step\n",
+                   RomsetName(romset),
+                   huge_pages ? "huge pages" : "regular pages",
+                   elapsed.count() * 1e9 / (double)num_steps);
+            StopCounters(num_steps);
+        }
+    }
+    return 0;
+}
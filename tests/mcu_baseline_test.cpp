@@ -0,0 +1,232 @@
+// Checks MCU_Step against results recorded from the original emulator (the upstream Nuked-SC55 code this tree started
+// from, before scheduled stepping, closed-form timers, lazy flags, the page table and the decode cache).
+//
+// mcu_schedule_test compares two modes of the current code with each other, so a change that affects both of them
+// passes it; this test doesn't. Pass `--print` to print the results of the current build in the form of the table
+// below.
+#include "synthetic_run.h"
+#include <cstdio>
+#include <cstring>
+
+static const uint64_t NUM_STEPS = 100000;
+
+// For --print
+static const char* ROMSET_IDENTIFIERS[ROMSET_COUNT] = {
+    "MK2", "ST", "MK1", "CM300", "JV880", "SCB55", "RLP3237", "SC155", "SC155MK2",
+};
+static const char* TEST_ROM_IDENTIFIERS[] = {"RANDOM", "RANDOM_POKE", "SLEEP_LOOP"};
+
+struct Expected
+{
+    TestCase  test;
+    RunResult result;
+};
+
+// clang-format off
+static const Expected EXPECTED[] = {
+    {{Romset::MK2, 6, TestRom::RANDOM},
+     {0x1223904c82a8abd6, 0xfa33a9b98703a412, 0x8ec3d4cf4325c2a3, 10859, 1200000, false}},
+    {{Romset::MK2, 7, TestRom::RANDOM},
+     {0x2669b7de9c487205, 0xb3f2849734e2924d, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::MK2, 3, TestRom::RANDOM_POKE},
+     {0x5a082e8287e71572, 0x636d351b00cceb53, 0x3d658f7cda6df253, 7105, 1200000, false}},
+    {{Romset::MK2, 8, TestRom::RANDOM_POKE},
+     {0xca71a41a7bdc2f59, 0xb88c83e4b73004a5, 0x6f783ad45a11f843, 13734, 1200000, false}},
+    {{Romset::MK2, 4, TestRom::SLEEP_LOOP},
+     {0x7fd6f5d88f16d7e3, 0xd6c456ffd90dc023, 0x024556eb06243bc3, 24022, 1201080, false}},
+    {{Romset::MK2, 5, TestRom::SLEEP_LOOP},
+     {0x4b0828b860492bc9, 0x8db1e023e02d4e78, 0x26718451f9f1af23, 24015, 1200744, false}},
+    {{Romset::ST, 6, TestRom::RANDOM},
+     {0x1223904c82a8abd6, 0xfa33a9b98703a412, 0x8ec3d4cf4325c2a3, 10859, 1200000, false}},
+    {{Romset::ST, 7, TestRom::RANDOM},
+     {0x2669b7de9c487205, 0xb3f2849734e2924d, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::ST, 3, TestRom::RANDOM_POKE},
+     {0x5a082e8287e71572, 0x636d351b00cceb53, 0x3d658f7cda6df253, 7105, 1200000, false}},
+    {{Romset::ST, 8, TestRom::RANDOM_POKE},
+     {0xca71a41a7bdc2f59, 0xb88c83e4b73004a5, 0x6f783ad45a11f843, 13734, 1200000, false}},
+    {{Romset::ST, 4, TestRom::SLEEP_LOOP},
+     {0x7fd6f5d88f16d7e3, 0xd6c456ffd90dc023, 0x024556eb06243bc3, 24022, 1201080, false}},
+    {{Romset::ST, 5, TestRom::SLEEP_LOOP},
+     {0x4b0828b860492bc9, 0x8db1e023e02d4e78, 0x26718451f9f1af23, 24015, 1200744, false}},
+    {{Romset::MK1, 6, TestRom::RANDOM},
+     {0x66eb22983746a95d, 0xd143eb38fdf5cbb7, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::MK1, 7, TestRom::RANDOM},
+     {0x50ada4a6855223f0, 0x7fb4e388a0b934d9, 0x2c8e493bb8826e6e, 22351, 1200000, false}},
+    {{Romset::MK1, 3, TestRom::RANDOM_POKE},
+     {0x51da3aad822e3a73, 0x0fd0fa1369a4525a, 0x7ac3b8fada310dd3, 6834, 1200000, false}},
+    {{Romset::MK1, 8, TestRom::RANDOM_POKE},
+     {0xc4a0cca67b4a0951, 0xc7184d489479354f, 0x83fc80bc41b3b4e3, 24525, 1200000, false}},
+    {{Romset::MK1, 4, TestRom::SLEEP_LOOP},
+     {0xbd438902c2d83980, 0x496fe03566fbbc17, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::MK1, 5, TestRom::SLEEP_LOOP},
+     {0xcac0c54a9ae1f14b, 0x6366fa97399a0d82, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::CM300, 6, TestRom::RANDOM},
+     {0x9336d995b61059ee, 0xf26c775a8e42e9af, 0x64fc4d4d6886c8c3, 10920, 1200000, false}},
+    {{Romset::CM300, 7, TestRom::RANDOM},
+     {0x2669b7de9c487205, 0xb3f2849734e2924d, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::CM300, 3, TestRom::RANDOM_POKE},
+     {0xb73ac2e7e307d436, 0x716ec7796a6c5961, 0x3d658f7cda6df253, 7105, 1200000, false}},
+    {{Romset::CM300, 8, TestRom::RANDOM_POKE},
+     {0x48c7d1de13a2ac1d, 0x230cb4644d9225c5, 0x9d02933af8b2a123, 13984, 1200000, false}},
+    {{Romset::CM300, 4, TestRom::SLEEP_LOOP},
+     {0xbd438902c2d83980, 0x496fe03566fbbc17, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::CM300, 5, TestRom::SLEEP_LOOP},
+     {0xcac0c54a9ae1f14b, 0x6366fa97399a0d82, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::JV880, 6, TestRom::RANDOM},
+     {0xd8ebb27645808e3a, 0x0f8923c7ffc19791, 0x6aa1d5336110e323, 9853, 1200000, false}},
+    {{Romset::JV880, 7, TestRom::RANDOM},
+     {0xd788da5f2bafc8d1, 0xb3f2849734e2924d, 0x9215421bb913f2a3, 27907, 1200000, false}},
+    {{Romset::JV880, 3, TestRom::RANDOM_POKE},
+     {0xfb926861dbc0fffa, 0xf7c11a1bf622f103, 0xf9f36dd1dd74b6f3, 8261, 1200000, false}},
+    {{Romset::JV880, 8, TestRom::RANDOM_POKE},
+     {0xa0c681676c36f2f3, 0xf153ff7c7e981afc, 0x7ecb13008aa34a33, 22166, 1200000, false}},
+    {{Romset::JV880, 4, TestRom::SLEEP_LOOP},
+     {0xdea25c1fdb4662ec, 0x71d30e3d57170c98, 0x9215421bb913f2a3, 27907, 1200000, false}},
+    {{Romset::JV880, 5, TestRom::SLEEP_LOOP},
+     {0x5074edca454ba2a2, 0xc4ec1fff3c8a2205, 0x9215421bb913f2a3, 27907, 1200000, false}},
+    {{Romset::SCB55, 6, TestRom::RANDOM},
+     {0x1223904c82a8abd6, 0xfa33a9b98703a412, 0x8ec3d4cf4325c2a3, 10859, 1200000, false}},
+    {{Romset::SCB55, 7, TestRom::RANDOM},
+     {0x2669b7de9c487205, 0xb3f2849734e2924d, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::SCB55, 3, TestRom::RANDOM_POKE},
+     {0xcc787cf498709056, 0x48cae94741183223, 0x3d658f7cda6df253, 7105, 1200000, false}},
+    {{Romset::SCB55, 8, TestRom::RANDOM_POKE},
+     {0x2f92ef9c37f0e7c1, 0x37d80a844195672f, 0x6f783ad45a11f843, 13734, 1200000, false}},
+    {{Romset::SCB55, 4, TestRom::SLEEP_LOOP},
+     {0x45cc624270a11aa0, 0x71d30e3d57170c98, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::SCB55, 5, TestRom::SLEEP_LOOP},
+     {0xf4a7ac3ba4f1efaa, 0xc4ec1fff3c8a2205, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::RLP3237, 6, TestRom::RANDOM},
+     {0x1223904c82a8abd6, 0xfa33a9b98703a412, 0x8ec3d4cf4325c2a3, 10859, 1200000, false}},
+    {{Romset::RLP3237, 7, TestRom::RANDOM},
+     {0x2669b7de9c487205, 0xb3f2849734e2924d, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::RLP3237, 3, TestRom::RANDOM_POKE},
+     {0xcc787cf498709056, 0x48cae94741183223, 0x3d658f7cda6df253, 7105, 1200000, false}},
+    {{Romset::RLP3237, 8, TestRom::RANDOM_POKE},
+     {0x2f92ef9c37f0e7c1, 0x37d80a844195672f, 0x6f783ad45a11f843, 13734, 1200000, false}},
+    {{Romset::RLP3237, 4, TestRom::SLEEP_LOOP},
+     {0x45cc624270a11aa0, 0x71d30e3d57170c98, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::RLP3237, 5, TestRom::SLEEP_LOOP},
+     {0xf4a7ac3ba4f1efaa, 0xc4ec1fff3c8a2205, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::SC155, 6, TestRom::RANDOM},
+     {0x9336d995b61059ee, 0xf26c775a8e42e9af, 0x64fc4d4d6886c8c3, 10920, 1200000, false}},
+    {{Romset::SC155, 7, TestRom::RANDOM},
+     {0x2669b7de9c487205, 0xb3f2849734e2924d, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::SC155, 3, TestRom::RANDOM_POKE},
+     {0xb73ac2e7e307d436, 0x716ec7796a6c5961, 0x3d658f7cda6df253, 7105, 1200000, false}},
+    {{Romset::SC155, 8, TestRom::RANDOM_POKE},
+     {0x48c7d1de13a2ac1d, 0x230cb4644d9225c5, 0x9d02933af8b2a123, 13984, 1200000, false}},
+    {{Romset::SC155, 4, TestRom::SLEEP_LOOP},
+     {0xbd438902c2d83980, 0x496fe03566fbbc17, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::SC155, 5, TestRom::SLEEP_LOOP},
+     {0xcac0c54a9ae1f14b, 0x6366fa97399a0d82, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::SC155MK2, 6, TestRom::RANDOM},
+     {0xb4be9055dfe46344, 0xfa33a9b98703a412, 0x8ec3d4cf4325c2a3, 10859, 1200000, false}},
+    {{Romset::SC155MK2, 7, TestRom::RANDOM},
+     {0x2669b7de9c487205, 0xb3f2849734e2924d, 0xf36cbe2231ce2b83, 24000, 1200000, false}},
+    {{Romset::SC155MK2, 3, TestRom::RANDOM_POKE},
+     {0x5a082e8287e71572, 0x636d351b00cceb53, 0x3d658f7cda6df253, 7105, 1200000, false}},
+    {{Romset::SC155MK2, 8, TestRom::RANDOM_POKE},
+     {0xca71a41a7bdc2f59, 0xb88c83e4b73004a5, 0x6f783ad45a11f843, 13734, 1200000, false}},
+    {{Romset::SC155MK2, 4, TestRom::SLEEP_LOOP},
+     {0x4254322c6d215fcb, 0xed76b3534ba5fe2f, 0x024556eb06243bc3, 24022, 1201080, false}},
+    {{Romset::SC155MK2, 5, TestRom::SLEEP_LOOP},
+     {0xaca0b175e28937f5, 0x9118ec39f6704a34, 0x26718451f9f1af23, 24015, 1200744, false}},
+};
+// clang-format on
+
+int main(int argc, char** argv)
+{
+    const bool print = argc > 1 && strcmp(argv[1], "--print") == 0;
+
+    size_t num_failed = 0;
+    size_t num_matched = 0;
+
+    for (size_t romset = 0; romset < ROMSET_COUNT; romset++)
+    {
+        const TestCase tests[] = {
+            {(Romset)romset, 6, TestRom::RANDOM},
+            {(Romset)romset, 7, TestRom::RANDOM},
+            {(Romset)romset, 3, TestRom::RANDOM_POKE},
+            {(Romset)romset, 8, TestRom::RANDOM_POKE},
+            {(Romset)romset, 4, TestRom::SLEEP_LOOP},
+            {(Romset)romset, 5, TestRom::SLEEP_LOOP},
+        };
+
+        for (const TestCase& test : tests)
+        {
+            RomsetInfo roms{};
+            MakeRoms(roms, test);
+
+            RunResult result{};
+            if (!Run(test, roms, NUM_STEPS * 12, false, result))
+            {
+                fprintf(stderr, "%s seed %u: could not load roms\n", RomsetName(test.romset), test.seed);
+                num_failed++;
+                continue;
+            }
+
+            if (print)
+            {
+                printf("    {{Romset::%s, %u, TestRom::%s},\n"
+                       "     {0x%016llx, 0x%016llx, 0x%016llx, %llu, %llu, %s}},\n",
+                       ROMSET_IDENTIFIERS[(size_t)test.romset],
+                       test.seed,
+                       TEST_ROM_IDENTIFIERS[(size_t)test.rom],
+                       (unsigned long long)result.trace,
+                       (unsigned long long)result.final_state,
+                       (unsigned long long)result.audio,
+                       (unsigned long long)result.num_frames,
+                       (unsigned long long)result.cycles,
+                       result.ended_asleep ? "true" : "false");
+                continue;
+            }
+
+            const Expected* expected = nullptr;
+            for (const Expected& entry : EXPECTED)
+            {
+                if (entry.test.romset == test.romset && entry.test.seed == test.seed && entry.test.rom == test.rom)
+                {
+                    expected = &entry;
+                }
+            }
+
+            if (expected && result == expected->result)
+            {
+                num_matched++;
+            }
+            else if (!expected)
+            {
+                fprintf(stderr, "%s seed %u (%s): no recorded result\n", RomsetName(test.romset), test.seed,
+                        TestRomName(test.rom));
+                num_failed++;
+            }
+            else
+            {
+                fprintf(stderr,
+                        "%s seed %u (%s): differs from the original emulator\n"
+                        "  trace  %016llx vs %016llx\n"
+                        "  final  %016llx vs %016llx\n"
+                        "  audio  %016llx vs %016llx (%llu vs %llu frames)\n",
+                        RomsetName(test.romset),
+                        test.seed,
+                        TestRomName(test.rom),
+                        (unsigned long long)result.trace,
+                        (unsigned long long)expected->result.trace,
+                        (unsigned long long)result.final_state,
+                        (unsigned long long)expected->result.final_state,
+                        (unsigned long long)result.audio,
+                        (unsigned long long)expected->result.audio,
+                        (unsigned long long)result.num_frames,
+                        (unsigned long long)expected->result.num_frames);
+                num_failed++;
+            }
+        }
+    }
+
+    if (!print)
+    {
+        printf("%zu of %zu runs matched\n", num_matched, num_matched + num_failed);
+    }
+    return num_failed == 0 ? 0 : 1;
+}
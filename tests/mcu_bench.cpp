@@ -0,0 +1,55 @@
+// Measures MCU_Step throughput in instructions per second, per romset, on the synthetic roms of synthetic_run.h. The
+// code is random, so it fetches and accesses memory all over the address space; the default seed keeps the MCU awake
+// for the whole run on every romset. Not run as a test.
+#include "synthetic_run.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static void DiscardFrame(void*, const AudioFrame<int32_t>&)
+{
+}
+
+int main(int argc, char** argv)
+{
+    const uint64_t num_steps = argc > 1 ? strtoull(argv[1], nullptr, 10) : 5000000;
+    const uint32_t seed      = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 7;
+
+    for (size_t romset = 0; romset < ROMSET_COUNT; romset++)
+    {
+        const TestCase test = {(Romset)romset, seed, TestRom::RANDOM};
+
+        RomsetInfo roms{};
+        MakeRoms(roms, test);
+
+        AllRomsetInfo all_info{};
+        all_info.romsets[romset] = roms;
+
+        Emulator emu;
+        if (!emu.Init(EMU_Options{}) || !emu.LoadRoms(test.romset, all_info))
+        {
+            fprintf(stderr, "%s: could not load roms\n", RomsetName(test.romset));
+            return 1;
+        }
+        emu.Reset();
+        emu.SetSampleCallback(DiscardFrame, nullptr);
+
+        mcu_t& mcu = emu.GetMCU();
+        uint64_t num_instructions = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < num_steps; i++)
+        {
+            num_instructions += !mcu.sleep;
+            emu.Step();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        printf("%-13s %6.2f MIPS (%llu of %llu steps awake)\n",
+               RomsetName(test.romset),
+               (double)num_instructions / elapsed.count() / 1e6,
+               (unsigned long long)num_instructions,
+               (unsigned long long)num_steps);
+    }
+    return 0;
+}
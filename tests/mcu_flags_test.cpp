@@ -0,0 +1,306 @@
+// Differential test for the lazily evaluated condition flags (see MCU_SyncFlags).
+//
+// Runs the ALU helpers against the eager implementation they replaced: every byte operand pair and edge and random
+// word operands, alone and in random sequences with the C updates and syncs that opcode handlers do in between, and
+// compares sr and the results.
+#include "mcu.h"
+#include "mcu_opcodes.h"
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+// The eager flag evaluation, as it was before flags were evaluated lazily
+namespace eager
+{
+
+static void SetStatus(uint16_t& sr, uint32_t condition, uint32_t mask)
+{
+    if (condition)
+        sr |= (uint16_t)mask;
+    else
+        sr &= (uint16_t)(~mask);
+}
+
+static int32_t SUB_Common(uint16_t& sr, int32_t t1, int32_t t2, int32_t c_bit, uint32_t siz)
+{
+    int32_t st1, st2;
+    int32_t N, Z, C, V = 0;
+    if (siz)
+    {
+        st1 = (int16_t)t1;
+        st2 = (int16_t)t2;
+        t1 = (uint16_t)t1;
+        t2 = (uint16_t)t2;
+        t1 -= t2;
+        t1 -= c_bit;
+        C = (t1 >> 16) & 1;
+
+        t1 &= 0xffff;
+        N = (t1 & 0x8000) != 0;
+        Z = t1 == 0;
+
+        st1 -= st2;
+        st1 -= c_bit;
+        if (st1 < INT16_MIN || st1 > INT16_MAX)
+            V = 1;
+    }
+    else
+    {
+        st1 = (int8_t)t1;
+        st2 = (int8_t)t2;
+        t1 = (uint8_t)t1;
+        t2 = (uint8_t)t2;
+        t1 -= t2;
+        t1 -= c_bit;
+        C = (t1 >> 8) & 1;
+
+        t1 &= 0xff;
+        N = (t1 & 0x80) != 0;
+        Z = t1 == 0;
+
+        st1 -= st2;
+        st1 -= c_bit;
+        if (st1 < INT8_MIN || st1 > INT8_MAX)
+            V = 1;
+    }
+    SetStatus(sr, N, STATUS_N);
+    SetStatus(sr, Z, STATUS_Z);
+    SetStatus(sr, C, STATUS_C);
+    SetStatus(sr, V, STATUS_V);
+
+    return t1;
+}
+
+static int32_t ADD_Common(uint16_t& sr, int32_t t1, int32_t t2, int32_t c_bit, uint32_t siz)
+{
+    int32_t st1, st2;
+    int32_t N, Z, C, V = 0;
+    if (siz)
+    {
+        st1 = (int16_t)t1;
+        st2 = (int16_t)t2;
+        t1 = (uint16_t)t1;
+        t2 = (uint16_t)t2;
+        t1 += t2;
+        t1 += c_bit;
+        C = (t1 >> 16) & 1;
+
+        t1 &= 0xffff;
+        N = (t1 & 0x8000) != 0;
+        Z = t1 == 0;
+
+        st1 += st2;
+        st1 += c_bit;
+        if (st1 < INT16_MIN || st1 > INT16_MAX)
+            V = 1;
+    }
+    else
+    {
+        st1 = (int8_t)t1;
+        st2 = (int8_t)t2;
+        t1 = (uint8_t)t1;
+        t2 = (uint8_t)t2;
+        t1 += t2;
+        t1 += c_bit;
+        C = (t1 >> 8) & 1;
+
+        t1 &= 0xff;
+        N = (t1 & 0x80) != 0;
+        Z = t1 == 0;
+
+        st1 += st2;
+        st1 += c_bit;
+        if (st1 < INT8_MIN || st1 > INT8_MAX)
+            V = 1;
+    }
+    SetStatus(sr, N, STATUS_N);
+    SetStatus(sr, Z, STATUS_Z);
+    SetStatus(sr, C, STATUS_C);
+    SetStatus(sr, V, STATUS_V);
+
+    return t1;
+}
+
+static void SetStatusCommon(uint16_t& sr, uint32_t val, uint32_t siz)
+{
+    if (siz)
+        val &= 0xffff;
+    else
+        val &= 0xff;
+    if (siz)
+        SetStatus(sr, val & 0x8000, STATUS_N);
+    else
+        SetStatus(sr, val & 0x80, STATUS_N);
+    SetStatus(sr, val == 0, STATUS_Z);
+    SetStatus(sr, 0, STATUS_V);
+}
+
+} // namespace eager
+
+enum class Op
+{
+    ADD,
+    SUB,
+    SET_STATUS,
+    // MCU_SetStatus on C, as the shift and rotate handlers do before MCU_SetStatusCommon
+    SET_C,
+    // Anything that reads sr in between
+    SYNC,
+};
+
+static const char* OP_NAMES[] = {"ADD", "SUB", "SET_STATUS", "SET_C", "SYNC"};
+
+struct Step
+{
+    Op       op;
+    int32_t  t1;
+    int32_t  t2;
+    int32_t  c_bit;
+    uint32_t siz;
+};
+
+// Runs `steps` on both implementations from the same sr. Returns false and reports the first step after which they
+// disagree.
+static bool RunSteps(mcu_t& mcu, uint16_t initial_sr, const Step* steps, size_t num_steps)
+{
+    mcu.sr = initial_sr;
+    mcu.flags_op = FLAGS_NONE;
+    uint16_t sr = initial_sr;
+
+    for (size_t i = 0; i < num_steps; i++)
+    {
+        const Step& step = steps[i];
+        int32_t lazy_result = 0;
+        int32_t eager_result = 0;
+        switch (step.op)
+        {
+        case Op::ADD:
+            lazy_result = MCU_ADD_Common(mcu, step.t1, step.t2, step.c_bit, step.siz);
+            eager_result = eager::ADD_Common(sr, step.t1, step.t2, step.c_bit, step.siz);
+            break;
+        case Op::SUB:
+            lazy_result = MCU_SUB_Common(mcu, step.t1, step.t2, step.c_bit, step.siz);
+            eager_result = eager::SUB_Common(sr, step.t1, step.t2, step.c_bit, step.siz);
+            break;
+        case Op::SET_STATUS:
+            MCU_SetStatusCommon(mcu, (uint32_t)step.t1, step.siz);
+            eager::SetStatusCommon(sr, (uint32_t)step.t1, step.siz);
+            break;
+        case Op::SET_C:
+            MCU_SetStatus(mcu, step.c_bit, STATUS_C);
+            eager::SetStatus(sr, step.c_bit, STATUS_C);
+            break;
+        case Op::SYNC:
+            break;
+        }
+
+        // Only sync on SYNC steps and at the end, so that operations also get replaced while still pending
+        if (step.op == Op::SYNC || i + 1 == num_steps)
+        {
+            MCU_SyncFlags(mcu);
+            if (mcu.sr != sr)
+            {
+                fprintf(stderr, "step %zu of %zu (%s %s t1=%x t2=%x c=%d) from sr=%04x: sr %04x, expected %04x\n",
+                        i + 1, num_steps, OP_NAMES[(size_t)step.op], step.siz ? "word" : "byte", step.t1, step.t2,
+                        step.c_bit, initial_sr, mcu.sr, sr);
+                return false;
+            }
+        }
+        if (lazy_result != eager_result)
+        {
+            fprintf(stderr, "step %zu of %zu (%s %s t1=%x t2=%x c=%d): result %x, expected %x\n", i + 1, num_steps,
+                    OP_NAMES[(size_t)step.op], step.siz ? "word" : "byte", step.t1, step.t2, step.c_bit, lazy_result,
+                    eager_result);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    auto mcu = std::make_unique<mcu_t>();
+    std::mt19937 rng(1);
+
+    size_t num_failed = 0;
+    size_t num_checked = 0;
+
+    auto check = [&](uint16_t initial_sr, const Step* steps, size_t num_steps) {
+        num_checked++;
+        if (!RunSteps(*mcu, initial_sr, steps, num_steps))
+            num_failed++;
+    };
+
+    // Every byte operand pair, including bits above the operand size
+    for (int32_t t1 = 0; t1 < 0x100; t1++)
+    {
+        for (int32_t t2 = 0; t2 < 0x100; t2++)
+        {
+            for (int32_t c_bit = 0; c_bit < 2; c_bit++)
+            {
+                const uint16_t initial_sr = (uint16_t)rng();
+                const int32_t high = (int32_t)(rng() & 0xff00);
+                const Step add = {Op::ADD, t1 | high, t2, c_bit, 0};
+                const Step sub = {Op::SUB, t1, t2 | high, c_bit, 0};
+                check(initial_sr, &add, 1);
+                check(initial_sr, &sub, 1);
+            }
+        }
+        const Step set_status = {Op::SET_STATUS, t1 | (int32_t)(rng() & 0xff00), 0, 0, 0};
+        check((uint16_t)rng(), &set_status, 1);
+    }
+
+    // Word operands around the sign and carry boundaries, and random ones
+    static const int32_t WORD_EDGES[] = {0, 1, 2, 0x7f, 0x80, 0xff, 0x100, 0x7ffe, 0x7fff, 0x8000, 0x8001, 0xfffe,
+                                         0xffff, 0x10000, 0x1ffff, -1, -0x8000};
+    std::vector<int32_t> words(std::begin(WORD_EDGES), std::end(WORD_EDGES));
+    for (int i = 0; i < 64; i++)
+        words.push_back((int32_t)(rng() & 0xffff));
+
+    for (int32_t t1 : words)
+    {
+        for (int32_t t2 : words)
+        {
+            for (int32_t c_bit = 0; c_bit < 2; c_bit++)
+            {
+                const Step add = {Op::ADD, t1, t2, c_bit, 1};
+                const Step sub = {Op::SUB, t1, t2, c_bit, 1};
+                check((uint16_t)rng(), &add, 1);
+                check((uint16_t)rng(), &sub, 1);
+            }
+        }
+        const Step set_status = {Op::SET_STATUS, t1, 0, 0, 1};
+        check((uint16_t)rng(), &set_status, 1);
+    }
+
+    // Random sequences, so that pending operations are replaced by other ones and C is changed in between
+    for (int i = 0; i < 200000; i++)
+    {
+        Step steps[6];
+        const size_t num_steps = 2 + rng() % 5;
+        for (size_t j = 0; j < num_steps; j++)
+        {
+            Step& step = steps[j];
+            step.op = (Op)(rng() % 5);
+            step.siz = rng() & 1;
+            step.c_bit = (int32_t)(rng() & 1);
+            if (rng() & 1)
+            {
+                step.t1 = WORD_EDGES[rng() % std::size(WORD_EDGES)];
+                step.t2 = WORD_EDGES[rng() % std::size(WORD_EDGES)];
+            }
+            else
+            {
+                step.t1 = (int32_t)(rng() & 0xffff);
+                step.t2 = (int32_t)(rng() & 0xffff);
+            }
+        }
+        check((uint16_t)rng(), steps, num_steps);
+    }
+
+    printf("%zu of %zu flag checks matched\n", num_checked - num_failed, num_checked);
+    return num_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+// Differential test for the scheduled stepping in MCU_Step (see MCU_NextEvent).
+//
+// Runs two emulators on the same synthetic roms, one of them with `run_every_update` set, and checks that their
+// state and audio stay identical. Sleeping is only fast-forwarded in the scheduled one, so external input (MIDI bytes,
+// peripheral writes) and state snapshots happen only while the MCU is awake: those are the same cycles either way.
+#include "synthetic_run.h"
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char** argv)
+{
+    const uint64_t num_steps = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+
+    size_t num_failed = 0;
+    size_t num_matched = 0;
+
+    for (size_t romset = 0; romset < ROMSET_COUNT; romset++)
+    {
+        const TestCase tests[] = {
+            {(Romset)romset, 1, TestRom::RANDOM},
+            {(Romset)romset, 2, TestRom::RANDOM},
+            {(Romset)romset, 3, TestRom::RANDOM_POKE},
+            {(Romset)romset, 4, TestRom::SLEEP_LOOP},
+            {(Romset)romset, 5, TestRom::SLEEP_LOOP},
+        };
+
+        for (const TestCase& test : tests)
+        {
+            RomsetInfo roms{};
+            MakeRoms(roms, test);
+
+            RunResult scheduled{};
+            RunResult reference{};
+            if (!Run(test, roms, num_steps * 12, false, scheduled) || !Run(test, roms, num_steps * 12, true, reference))
+            {
+                fprintf(stderr, "%s seed %u: could not load roms\n", RomsetName(test.romset), test.seed);
+                num_failed++;
+                continue;
+            }
+
+            if (scheduled == reference)
+            {
+                num_matched++;
+            }
+            else
+            {
+                fprintf(stderr,
+                        "%s seed %u (%s): scheduled stepping diverged\n"
+                        "  trace  %016llx vs %016llx\n"
+                        "  final  %016llx vs %016llx\n"
+                        "  audio  %016llx vs %016llx (%llu vs %llu frames)\n",
+                        RomsetName(test.romset),
+                        test.seed,
+                        TestRomName(test.rom),
+                        (unsigned long long)scheduled.trace,
+                        (unsigned long long)reference.trace,
+                        (unsigned long long)scheduled.final_state,
+                        (unsigned long long)reference.final_state,
+                        (unsigned long long)scheduled.audio,
+                        (unsigned long long)reference.audio,
+                        (unsigned long long)scheduled.num_frames,
+                        (unsigned long long)reference.num_frames);
+                num_failed++;
+            }
+        }
+    }
+
+    printf("%zu of %zu runs matched\n", num_matched, num_matched + num_failed);
+    return num_failed == 0 ? 0 : 1;
+}
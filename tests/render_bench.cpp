@@ -0,0 +1,147 @@
+// Measures how fast one instance renders audio on one thread, per romset, in frames per second and as a multiple of
+// real time, with the MCU and PCM stepped in lockstep as the plugin does. This is the baseline a pipelined MCU/PCM mode
+// would have to beat (see the note above PCM_Write). It then runs one instance per thread on 1 to N threads, which is
+// the scaling the host already gets from running several instances. Not run as a test.
+#include "synthetic_run.h"
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+struct RenderResult
+{
+    uint64_t num_frames = 0;
+    uint32_t frequency  = 0;
+    double   seconds    = 0;
+
+    std::chrono::steady_clock::time_point end;
+};
+
+static void CountFrame(void* userdata, const AudioFrame<int32_t>&)
+{
+    ++*(uint64_t*)userdata;
+}
+
+// Waits at `ready`, if given, before starting the clock, so that the threads start rendering together
+static bool Render(Romset romset, uint64_t num_frames, RenderResult& result, std::barrier<>* ready = nullptr)
+{
+    // Stays awake for the whole run, see mcu_bench
+    const TestCase test = {romset, 7, TestRom::RANDOM};
+
+    RomsetInfo roms{};
+    MakeRoms(roms, test);
+
+    AllRomsetInfo all_info{};
+    all_info.romsets[(size_t)romset] = roms;
+
+    Emulator emu;
+    if (!emu.Init(EMU_Options{}) || !emu.LoadRoms(romset, all_info))
+    {
+        return false;
+    }
+    emu.Reset();
+
+    uint64_t frames = 0;
+    emu.SetSampleCallback(CountFrame, &frames);
+
+    if (ready)
+    {
+        ready->arrive_and_wait();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    while (frames < num_frames)
+    {
+        emu.Step();
+    }
+    result.end = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed = result.end - start;
+
+    result.num_frames = frames;
+    result.frequency  = PCM_GetOutputFrequency(emu.GetPCM());
+    result.seconds    = elapsed.count();
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const uint64_t num_frames  = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    const unsigned max_threads = argc > 2 ? (unsigned)strtoul(argv[2], nullptr, 10)
+                                          : std::max(1u, std::thread::hardware_concurrency());
+
+    printf("one instance, one thread:\n");
+    for (size_t romset = 0; romset < ROMSET_COUNT; romset++)
+    {
+        RenderResult result;
+        if (!Render((Romset)romset, num_frames, result))
+        {
+            fprintf(stderr, "%s: could not load roms\n", RomsetName((Romset)romset));
+            return 1;
+        }
+        printf("  %-13s %9.0f frames/s at %u Hz, %5.2fx real time\n",
+               RomsetName((Romset)romset),
+               (double)result.num_frames / result.seconds,
+               result.frequency,
+               (double)result.num_frames / result.frequency / result.seconds);
+    }
+
+    printf("one SC-55mk2 instance per thread:\n");
+    std::vector<unsigned> thread_counts;
+    for (unsigned num_threads = 1; num_threads < max_threads; num_threads *= 2)
+    {
+        thread_counts.push_back(num_threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    for (unsigned num_threads : thread_counts)
+    {
+        std::vector<RenderResult> results(num_threads);
+        std::vector<std::thread> threads;
+        std::atomic<bool> ok = true;
+
+        // One extra participant for this thread, which starts the clock once every instance is set up
+        std::barrier<> ready((ptrdiff_t)num_threads + 1);
+
+        for (unsigned i = 0; i < num_threads; i++)
+        {
+            threads.emplace_back([&, i] {
+                if (!Render(Romset::MK2, num_frames, results[i], &ready))
+                {
+                    ok = false;
+                    ready.arrive_and_drop();
+                }
+            });
+        }
+        ready.arrive_and_wait();
+        const auto start = std::chrono::steady_clock::now();
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "could not load roms\n");
+            return 1;
+        }
+
+        double emulated_seconds = 0;
+        auto   end              = start;
+        for (const RenderResult& result : results)
+        {
+            emulated_seconds += (double)result.num_frames / result.frequency;
+            end = std::max(end, result.end);
+        }
+        const std::chrono::duration<double> elapsed = end - start;
+        printf("  %3u threads: %6.2fx real time in total, %5.2fx per instance\n",
+               num_threads,
+               emulated_seconds / elapsed.count(),
+               emulated_seconds / elapsed.count() / num_threads);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Measures PolyphaseResampler throughput from the emulator's native rates (with oversampling disabled) to the host
+// rates it supports, at each quality, in output frames per second and as a multiple of real time. Not run as a test.
+#include "resampler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static const char* QualityName(PolyphaseResampler::Quality quality)
+{
+    switch (quality)
+    {
+    case PolyphaseResampler::Quality::Low:
+        return "low";
+    case PolyphaseResampler::Quality::Medium:
+        return "medium";
+    case PolyphaseResampler::Quality::High:
+        return "high";
+    }
+    return "?";
+}
+
+int main(int argc, char** argv)
+{
+    const double seconds = argc > 1 ? atof(argv[1]) : 20.0;
+
+    // Output frames per Process call, as for a typical host block
+    const uint32_t block_frames = 512;
+
+    const uint32_t in_rates[]  = {32000, 33103};
+    const uint32_t out_rates[] = {44100, 48000, 88200, 96000};
+    const PolyphaseResampler::Quality qualities[] = {
+        PolyphaseResampler::Quality::Low,
+        PolyphaseResampler::Quality::Medium,
+        PolyphaseResampler::Quality::High,
+    };
+
+    // One second of noise, looped
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    std::vector<AudioFrame<float>> input(33103);
+    for (AudioFrame<float>& frame : input)
+    {
+        frame.left  = noise(rng);
+        frame.right = noise(rng);
+    }
+
+    std::vector<float> out_left(block_frames);
+    std::vector<float> out_right(block_frames);
+
+    for (uint32_t in_rate : in_rates)
+    {
+        for (uint32_t out_rate : out_rates)
+        {
+            for (PolyphaseResampler::Quality quality : qualities)
+            {
+                PolyphaseResampler resampler;
+                if (!resampler.Init(in_rate, out_rate, quality))
+                {
+                    fprintf(stderr, "%u -> %u Hz is not supported\n", in_rate, out_rate);
+                    continue;
+                }
+
+                const uint64_t total_frames = (uint64_t)(seconds * out_rate);
+                uint64_t num_written = 0;
+                size_t pos = 0;
+
+                const auto start = std::chrono::steady_clock::now();
+                while (num_written < total_frames)
+                {
+                    if (pos == input.size())
+                    {
+                        pos = 0;
+                    }
+                    uint32_t in_len  = (uint32_t)std::min<size_t>(input.size() - pos, block_frames);
+                    uint32_t out_len = block_frames;
+
+                    resampler.Process(std::span(input).subspan(pos), in_len, out_left.data(), out_right.data(),
+                                      out_len);
+
+                    pos += in_len;
+                    num_written += out_len;
+                }
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                printf("%5u -> %5u Hz, %-6s: %7.2f M frames/s, %6.0fx real time\n",
+                       in_rate,
+                       out_rate,
+                       QualityName(quality),
+                       (double)num_written / elapsed.count() / 1e6,
+                       (double)num_written / out_rate / elapsed.count());
+            }
+        }
+    }
+    return 0;
+}
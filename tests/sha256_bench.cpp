@@ -0,0 +1,46 @@
+// Measures SHA-256 throughput on rom-sized buffers through the public interface, i.e. with whichever compression
+// function the running CPU supports. Not run as a test.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+extern "C"
+{
+#include "sha/sha.h"
+}
+
+int main(int argc, char** argv)
+{
+    // Program roms and waveroms
+    const size_t sizes[]    = {0x8000, 0x80000, 0x100000, 0x200000};
+    const int    iterations = argc > 1 ? atoi(argv[1]) : 20;
+
+    std::mt19937 rng(1);
+
+    std::vector<uint8_t> data(0x200000);
+    for (uint8_t& byte : data)
+    {
+        byte = (uint8_t)rng();
+    }
+
+    for (size_t size : sizes)
+    {
+        uint8_t digest[SHA256HashSize];
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            SHA256Context ctx;
+            SHA256Reset(&ctx);
+            SHA256Input(&ctx, data.data(), (unsigned int)size);
+            SHA256Result(&ctx, digest);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        printf("SHA-256 of %7zu bytes: %.1f MB/s\n", size, (double)size * iterations / elapsed.count() / 1e6);
+    }
+    return 0;
+}
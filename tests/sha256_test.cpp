@@ -0,0 +1,168 @@
+// SHA-256 known-answer test, run with the compression function picked for this CPU and with the portable one.
+//
+// Checks the FIPS 180 example messages, and that feeding a message in odd-sized pieces gives the same digest as
+// feeding it at once.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include "sha/sha-private.h"
+#include "sha/sha.h"
+}
+
+struct KnownAnswer
+{
+    const char* name;
+    std::string message;
+    const char* digest;
+};
+
+static std::string ToHex(const uint8_t (&digest)[SHA256HashSize])
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (uint8_t byte : digest)
+    {
+        hex += digits[byte >> 4];
+        hex += digits[byte & 15];
+    }
+    return hex;
+}
+
+// Feeds `size` bytes in pieces of the sizes in `pieces`, repeating the last one
+static std::string Digest(const uint8_t* data, size_t size, const std::vector<size_t>& pieces)
+{
+    SHA256Context ctx;
+    SHA256Reset(&ctx);
+
+    size_t pos = 0;
+    size_t piece = 0;
+    while (pos < size)
+    {
+        const size_t n = std::min(size - pos, pieces[piece]);
+        SHA256Input(&ctx, data + pos, (unsigned int)n);
+        pos += n;
+        if (piece + 1 < pieces.size())
+        {
+            piece++;
+        }
+    }
+
+    uint8_t digest[SHA256HashSize];
+    SHA256Result(&ctx, digest);
+    return ToHex(digest);
+}
+
+static std::string Digest(const std::string& message, const std::vector<size_t>& pieces)
+{
+    return Digest((const uint8_t*)message.data(), message.size(), pieces);
+}
+
+int main()
+{
+    const KnownAnswer known_answers[] = {
+        {"empty", "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"448 bits",
+         "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {"896 bits",
+         "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+         "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+        {"one million 'a'",
+         std::string(1000000, 'a'),
+         "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+
+    // Whole, byte by byte, and straddling block boundaries in every way
+    const std::vector<size_t> piece_sizes[] = {
+        {SIZE_MAX},
+        {1},
+        {3, 61, 64, 65, 127, 1},
+        {63, 129, 7, 4096},
+        {55, 56, 57, 997},
+    };
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> random_data(70000);
+    for (uint8_t& byte : random_data)
+    {
+        byte = (uint8_t)rng();
+    }
+
+    // Lengths around the padding boundaries (55/56 bytes into a block) and some larger odd ones
+    std::vector<size_t> lengths;
+    for (size_t length = 0; length <= 260; length++)
+    {
+        lengths.push_back(length);
+    }
+    for (size_t length : {1000, 4095, 4097, 65535, 65537, 69999})
+    {
+        lengths.push_back(length);
+    }
+
+    // Reference digests of the random data, fed at once with the portable implementation
+    const int have_accelerated = SHA256_UsePortableCompress(1);
+    std::vector<std::string> reference;
+    for (size_t length : lengths)
+    {
+        reference.push_back(Digest(random_data.data(), length, {SIZE_MAX}));
+    }
+
+    size_t num_failed = 0;
+    size_t num_checked = 0;
+
+    for (int portable = 0; portable < 2; portable++)
+    {
+        SHA256_UsePortableCompress(portable);
+        const char* impl_name = portable ? "portable" : (have_accelerated ? "accelerated" : "selected (portable)");
+
+        for (const KnownAnswer& answer : known_answers)
+        {
+            for (const std::vector<size_t>& pieces : piece_sizes)
+            {
+                // Byte by byte takes a while for the long message and adds nothing
+                if (pieces.size() == 1 && pieces[0] == 1 && answer.message.size() > 1000)
+                {
+                    continue;
+                }
+
+                num_checked++;
+                const std::string digest = Digest(answer.message, pieces);
+                if (digest != answer.digest)
+                {
+                    fprintf(stderr, "%s: %s in pieces of %zu...: %s, expected %s\n", impl_name, answer.name,
+                            pieces[0], digest.c_str(), answer.digest);
+                    num_failed++;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < lengths.size(); i++)
+        {
+            for (const std::vector<size_t>& pieces : piece_sizes)
+            {
+                num_checked++;
+                const std::string digest = Digest(random_data.data(), lengths[i], pieces);
+                if (digest != reference[i])
+                {
+                    fprintf(stderr, "%s: %zu random bytes in pieces of %zu...: %s, expected %s\n", impl_name,
+                            lengths[i], pieces[0], digest.c_str(), reference[i].c_str());
+                    num_failed++;
+                }
+            }
+        }
+    }
+
+    // Leave the CPU-specific implementation selected
+    SHA256_UsePortableCompress(0);
+
+    printf("%zu of %zu digests matched (%s)\n", num_checked - num_failed, num_checked,
+           have_accelerated ? "accelerated and portable" : "portable only");
+    return num_failed == 0 ? 0 : 1;
+}
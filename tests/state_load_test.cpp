@@ -0,0 +1,150 @@
+// Checks that STATE_Load rejects states whose index fields are out of range.
+//
+// For each checked field, a state is saved with the field set to a bad value and loaded back into an emulator in a
+// known state. The load has to fail and leave the emulator untouched; the same state with the field at its largest
+// valid value has to load.
+#include "emu.h"
+#include "mcu_interrupt.h"
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+struct FieldCase
+{
+    const char* name;
+    // Sets the field to the value given, which is either `valid` or `invalid`
+    std::function<void(Emulator&, uint32_t)> set;
+    uint32_t valid;
+    uint32_t invalid;
+};
+
+static const FieldCase FIELDS[] = {
+    {"mcu.interrupt_pending",
+     [](Emulator& emu, uint32_t v) { emu.GetMCU().interrupt_pending = v; },
+     (1u << INTERRUPT_SOURCE_MAX) - 1,
+     1u << INTERRUPT_SOURCE_MAX},
+    {"mcu.uart_write_ptr",
+     [](Emulator& emu, uint32_t v) { emu.GetMCU().uart_write_ptr = v; },
+     uart_buffer_size - 1,
+     uart_buffer_size},
+    {"mcu.uart_read_ptr",
+     [](Emulator& emu, uint32_t v) { emu.GetMCU().uart_read_ptr = v; },
+     uart_buffer_size - 1,
+     0x80000000},
+    {"mcu.operand_reg", [](Emulator& emu, uint32_t v) { emu.GetMCU().operand_reg = (uint8_t)v; }, 7, 8},
+    {"pcm.select_channel", [](Emulator& emu, uint32_t v) { emu.GetPCM().select_channel = v; }, 31, 32},
+    {"pcm.config.reg_slots", [](Emulator& emu, uint32_t v) { emu.GetPCM().config.reg_slots = (int)v; }, 32, 33},
+    {"pcm.config.reg_slots", [](Emulator& emu, uint32_t v) { emu.GetPCM().config.reg_slots = (int)v; }, 1, 0},
+    {"lcd.LCD_DD_RAM", [](Emulator& emu, uint32_t v) { emu.GetLCD().LCD_DD_RAM = v; }, 0x7f, 0x80},
+    {"lcd.LCD_AC", [](Emulator& emu, uint32_t v) { emu.GetLCD().LCD_AC = v; }, 0x7f, 0xffffffff},
+    {"lcd.LCD_CG_RAM", [](Emulator& emu, uint32_t v) { emu.GetLCD().LCD_CG_RAM = v; }, 63, 64},
+};
+
+static bool Boot(Emulator& emu, Romset romset)
+{
+    std::mt19937 rng(1);
+
+    AllRomsetInfo all_info{};
+    RomsetInfo& info = all_info.romsets[(size_t)romset];
+
+    auto fill = [&](RomLocation location, size_t size) {
+        std::vector<uint8_t>& data = info.rom_data[(size_t)location];
+        data.resize(size);
+        for (uint8_t& byte : data)
+        {
+            byte = (uint8_t)rng();
+        }
+    };
+
+    fill(RomLocation::ROM1, 0x8000);
+    fill(RomLocation::ROM2, romset == Romset::MK1 ? 0x40000 : 0x80000);
+    fill(RomLocation::SMROM, 0x1000);
+    fill(RomLocation::WAVEROM1, 0x100000);
+    fill(RomLocation::WAVEROM2, 0x100000);
+    fill(RomLocation::WAVEROM3, 0x100000);
+
+    if (!emu.Init(EMU_Options{}) || !emu.LoadRoms(romset, all_info))
+    {
+        return false;
+    }
+    emu.Reset();
+
+    // Run a little so that the state isn't all zeroes
+    for (int i = 0; i < 10000; i++)
+    {
+        emu.Step();
+    }
+    return true;
+}
+
+int main()
+{
+    size_t num_failed = 0;
+    size_t num_passed = 0;
+
+    for (size_t romset = 0; romset < ROMSET_COUNT; romset++)
+    {
+        Emulator emu;
+        if (!Boot(emu, (Romset)romset))
+        {
+            fprintf(stderr, "%s: could not load roms\n", RomsetName((Romset)romset));
+            num_failed++;
+            continue;
+        }
+
+        std::vector<uint8_t> reference;
+        emu.SaveState(reference);
+
+        for (const FieldCase& field : FIELDS)
+        {
+            std::vector<uint8_t> bad_state;
+            std::vector<uint8_t> good_state;
+            std::vector<uint8_t> after;
+
+            field.set(emu, field.invalid);
+            emu.SaveState(bad_state);
+            field.set(emu, field.valid);
+            emu.SaveState(good_state);
+
+            if (!emu.LoadState(reference))
+            {
+                fprintf(stderr, "%s: could not load the reference state\n", RomsetName((Romset)romset));
+                num_failed++;
+                continue;
+            }
+
+            bool passed = true;
+            if (emu.LoadState(bad_state))
+            {
+                fprintf(stderr, "%s: %s = %u was accepted\n", RomsetName((Romset)romset), field.name, field.invalid);
+                passed = false;
+            }
+            emu.SaveState(after);
+            if (after != reference)
+            {
+                fprintf(stderr, "%s: rejecting %s modified the emulator\n", RomsetName((Romset)romset), field.name);
+                passed = false;
+            }
+            if (!emu.LoadState(good_state))
+            {
+                fprintf(stderr, "%s: %s = %u was rejected\n", RomsetName((Romset)romset), field.name, field.valid);
+                passed = false;
+            }
+
+            emu.LoadState(reference);
+            if (passed)
+            {
+                num_passed++;
+            }
+            else
+            {
+                num_failed++;
+            }
+        }
+    }
+
+    printf("%zu of %zu state checks passed\n", num_passed, num_passed + num_failed);
+    return num_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+// Runs the emulator on synthetic roms and hashes its state and audio along the way. Shared by the tests that compare
+// MCU_Step against a reference.
+//
+// External input (MIDI bytes, peripheral writes) and state snapshots happen only while the MCU is awake, at the same
+// cycles whether or not sleeping is fast-forwarded.
+#pragma once
+
+#include "emu.h"
+#include "mcu_interrupt.h"
+#include "mcu_timer.h"
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+// Inputs and snapshots are spaced this many cycles apart
+inline constexpr uint64_t MIDI_INTERVAL  = 5000 * 12;
+inline constexpr uint64_t TRACE_INTERVAL = 997 * 12;
+
+// How long a run may keep going past its end while the MCU is asleep
+inline constexpr uint64_t MAX_SLEEP_CYCLES = 2400000;
+
+enum class TestRom
+{
+    // Random code with SLEEP and RTE sprinkled in
+    RANDOM,
+    // Random code, and random writes to the peripherals while running
+    RANDOM_POKE,
+    // A main loop that sleeps, and an FRT1 interrupt that wakes it up
+    SLEEP_LOOP,
+};
+
+struct TestCase
+{
+    Romset   romset;
+    uint32_t seed;
+    TestRom  rom;
+};
+
+struct RunResult
+{
+    uint64_t trace        = 0;
+    uint64_t final_state  = 0;
+    uint64_t audio        = 0;
+    uint64_t num_frames   = 0;
+    uint64_t cycles       = 0;
+    bool     ended_asleep = false;
+
+    bool operator==(const RunResult&) const = default;
+};
+
+inline void Hash(uint64_t& hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+template <typename T>
+inline void HashValue(uint64_t& hash, const T& value)
+{
+    Hash(hash, &value, sizeof(value));
+}
+
+inline void HashFrame(void* userdata, const AudioFrame<int32_t>& frame)
+{
+    RunResult& result = *(RunResult*)userdata;
+    HashValue(result.audio, frame);
+    result.num_frames++;
+}
+
+inline uint64_t HashState(Emulator& emu)
+{
+    uint64_t hash = 1469598103934665603ull;
+
+    mcu_t& mcu = emu.GetMCU();
+    MCU_SyncFlags(mcu);
+    Hash(hash, mcu.r, sizeof(mcu.r));
+    HashValue(hash, mcu.pc);
+    HashValue(hash, mcu.sr);
+    HashValue(hash, mcu.cp);
+    HashValue(hash, mcu.dp);
+    HashValue(hash, mcu.ep);
+    HashValue(hash, mcu.tp);
+    HashValue(hash, mcu.br);
+    HashValue(hash, mcu.sleep);
+    HashValue(hash, mcu.cycles);
+    for (uint32_t source = 0; source < INTERRUPT_SOURCE_MAX; source++)
+    {
+        HashValue(hash, (uint8_t)((mcu.interrupt_pending >> source) & 1));
+    }
+    HashValue(hash, mcu.exception_pending);
+    Hash(hash, mcu.ram, RAM_SIZE);
+    Hash(hash, mcu.sram, SRAM_SIZE);
+    Hash(hash, mcu.dev_register, sizeof(mcu.dev_register));
+    HashValue(hash, mcu.uart_read_ptr);
+    HashValue(hash, mcu.uart_rx_byte);
+    HashValue(hash, mcu.io_sd);
+    HashValue(hash, mcu.ga_int_trigger);
+
+    pcm_t& pcm = emu.GetPCM();
+    Hash(hash, pcm.ram1, sizeof(pcm.ram1));
+    Hash(hash, pcm.ram2, sizeof(pcm.ram2));
+    Hash(hash, pcm.eram, sizeof(pcm.eram));
+    HashValue(hash, pcm.accum_l);
+    HashValue(hash, pcm.accum_r);
+    HashValue(hash, pcm.voice_mask);
+    HashValue(hash, pcm.irq_assert);
+
+    // The timers are only brought up to date when something reads them
+    mcu_timer_t& timer = *mcu.timer;
+    TIMER_Clock(timer, mcu.cycles);
+    HashValue(hash, timer.tcnt);
+    HashValue(hash, timer.tcsr);
+    for (const frt_t& frt : timer.frt)
+    {
+        HashValue(hash, frt.frc);
+        HashValue(hash, frt.tcsr);
+    }
+
+    return hash;
+}
+
+inline void MakeRoms(RomsetInfo& info, const TestCase& test)
+{
+    std::mt19937 rng(test.seed);
+
+    auto fill = [&](RomLocation location, size_t size) {
+        std::vector<uint8_t>& data = info.rom_data[(size_t)location];
+        data.resize(size);
+        for (uint8_t& byte : data)
+        {
+            byte = (uint8_t)rng();
+        }
+    };
+
+    fill(RomLocation::ROM1, 0x8000);
+    fill(RomLocation::ROM2, test.romset == Romset::MK1 ? 0x40000 : 0x80000);
+    fill(RomLocation::SMROM, 0x1000);
+    fill(RomLocation::WAVEROM1, 0x100000);
+    fill(RomLocation::WAVEROM2, 0x100000);
+    fill(RomLocation::WAVEROM3, 0x100000);
+
+    std::vector<uint8_t>& rom1 = info.rom_data[(size_t)RomLocation::ROM1];
+
+    // Point every vector into rom1
+    for (size_t vector = 0; vector < 64; vector++)
+    {
+        const uint32_t address = 0x100 + (rng() % 0x7e00);
+        rom1[vector * 4 + 0] = 0;
+        rom1[vector * 4 + 1] = 0;
+        rom1[vector * 4 + 2] = (uint8_t)(address >> 8);
+        rom1[vector * 4 + 3] = (uint8_t)address;
+    }
+
+    if (test.rom == TestRom::SLEEP_LOOP)
+    {
+        // Reset vector -> 0x1000, everything else -> 0x2000
+        for (size_t vector = 0; vector < 64; vector++)
+        {
+            rom1[vector * 4 + 2] = vector == 0 ? 0x10 : 0x20;
+            rom1[vector * 4 + 3] = 0x00;
+        }
+
+        // ANDC #0x00 (enable interrupts), loop: SLEEP, BRA loop
+        const uint8_t main_code[] = {0x0c, 0x00, 0x00, 0x88, 0x1a, 0x20, 0xfd};
+        // Acknowledge the FRT1 compare match, RTE
+        const uint8_t isr_code[] = {0x15, 0xff, 0x91, 0x80, 0x15, 0xff, 0x91, 0x06, 0x01, 0x0a};
+
+        memcpy(&rom1[0x1000], main_code, sizeof(main_code));
+        memcpy(&rom1[0x2000], isr_code, sizeof(isr_code));
+    }
+    else
+    {
+        // Sprinkle SLEEP and RTE so that sleeping and interrupts happen
+        for (size_t i = 0; i < 40; i++)
+        {
+            rom1[0x100 + rng() % 0x7e00] = (rng() & 1) ? 0x1a : 0x0a;
+        }
+    }
+}
+
+inline void SetupSleepLoop(mcu_t& mcu, uint32_t seed)
+{
+    const uint16_t ocra = (uint16_t)(0x80 + seed * 37);
+
+    MCU_Write(mcu, 0xff90, (uint8_t)(0x20 | (seed & 3))); // FRT1 TCR: OCIA enable, clock select
+    MCU_Write(mcu, 0xff94, (uint8_t)(ocra >> 8));
+    MCU_Write(mcu, 0xff95, (uint8_t)ocra);
+    MCU_Write(mcu, 0xff91, 0x01); // clear on compare match A
+    MCU_Write(mcu, 0xfff1, 0x50); // IPRB
+    if (seed & 4)
+    {
+        MCU_Write(mcu, 0xffda, 0x50); // SCR: receive and receive interrupt
+        MCU_Write(mcu, 0xfff3, 0x50); // IPRD
+    }
+}
+
+inline bool Run(const TestCase& test, const RomsetInfo& roms, uint64_t num_cycles, bool every_update,
+                RunResult& result)
+{
+    AllRomsetInfo all_info{};
+    all_info.romsets[(size_t)test.romset] = roms;
+
+    Emulator emu;
+    if (!emu.Init(EMU_Options{}) || !emu.LoadRoms(test.romset, all_info))
+    {
+        return false;
+    }
+    emu.Reset();
+    emu.GetPCM().disable_oversampling = (test.seed & 1) != 0;
+    emu.SetSampleCallback(HashFrame, &result);
+
+    mcu_t& mcu = emu.GetMCU();
+    mcu.run_every_update = every_update;
+
+    if (test.rom == TestRom::SLEEP_LOOP)
+    {
+        SetupSleepLoop(mcu, test.seed);
+    }
+
+    std::mt19937 rng(test.seed * 7919);
+
+    uint64_t next_midi = 0;
+    uint64_t next_poke = 0;
+    uint64_t next_trace = 0;
+
+    result.audio = 1469598103934665603ull;
+
+    while (mcu.cycles < num_cycles || (mcu.sleep && mcu.cycles < num_cycles + MAX_SLEEP_CYCLES))
+    {
+        if (!mcu.sleep)
+        {
+            if (mcu.cycles >= next_midi)
+            {
+                emu.PostMIDI((uint8_t)rng());
+                next_midi = mcu.cycles + MIDI_INTERVAL;
+            }
+
+            if (test.rom == TestRom::RANDOM_POKE && mcu.cycles >= next_poke)
+            {
+                // Exercise the peripherals directly, as firmware would. RAME is left alone so that the code stays
+                // mapped.
+                const uint32_t kind = rng() % 100;
+                const uint8_t value = (uint8_t)rng();
+                if (kind < 60)
+                {
+                    const uint32_t reg = rng() % 0x80;
+                    if (reg != DEV_RAME)
+                    {
+                        MCU_Write(mcu, 0xff80 | reg, value);
+                    }
+                }
+                else if (kind < 85)
+                {
+                    MCU_Write(mcu, (test.romset == Romset::JV880 ? 0xf000 : 0xe000) | (rng() % 0x40), value);
+                }
+                else
+                {
+                    MCU_Write(mcu, 0xf104 + (rng() % 2), value);
+                }
+                next_poke = mcu.cycles + (20 + test.seed * 10) * 12;
+            }
+
+            if (mcu.cycles >= next_trace)
+            {
+                result.trace = result.trace * 31 + (HashState(emu) ^ result.audio ^ result.num_frames);
+                next_trace = mcu.cycles + TRACE_INTERVAL;
+            }
+        }
+        emu.Step();
+    }
+
+    // A run that ends asleep may have been fast-forwarded past the other one, so only the trace, which includes the
+    // audio so far, can be compared
+    result.ended_asleep = mcu.sleep != 0;
+    if (result.ended_asleep)
+    {
+        result.audio = 0;
+        result.num_frames = 0;
+    }
+    else
+    {
+        result.final_state = HashState(emu);
+        result.cycles = mcu.cycles;
+    }
+    return true;
+}
+
+inline const char* TestRomName(TestRom rom)
+{
+    switch (rom)
+    {
+    case TestRom::RANDOM:
+        return "random";
+    case TestRom::RANDOM_POKE:
+        return "random+poke";
+    case TestRom::SLEEP_LOOP:
+        return "sleep loop";
+    }
+    return "?";
+}
@@ -0,0 +1,76 @@
+// Measures how fast TIMER_Clock catches the timers up, in timer ticks per second, for a range of catch-up distances:
+// one MCU step, a few hundred steps, and a long sleep. All three FRTs and the 8-bit timer are running with compare
+// matches that clear the counters, so every call crosses compare values. Not run as a test.
+#include "synthetic_run.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static void SetupTimers(mcu_t& mcu)
+{
+    for (uint32_t frt = 0; frt < 3; frt++)
+    {
+        const uint32_t base = 0xff90 + frt * 0x10;
+        const uint16_t ocra = (uint16_t)(0x100 + frt * 0x333);
+        const uint16_t ocrb = ocra / 2;
+
+        MCU_Write(mcu, base + 0, (uint8_t)frt); // TCR: clock select
+        MCU_Write(mcu, base + 4, (uint8_t)(ocra >> 8));
+        MCU_Write(mcu, base + 5, (uint8_t)ocra);
+        MCU_Write(mcu, base + 6, (uint8_t)(ocrb >> 8));
+        MCU_Write(mcu, base + 7, (uint8_t)ocrb);
+        MCU_Write(mcu, base + 1, 0x01); // TCSR: clear on compare match A
+    }
+
+    MCU_Write(mcu, 0xff80 | DEV_TMR_TCORA, 0xc0);
+    MCU_Write(mcu, 0xff80 | DEV_TMR_TCORB, 0x40);
+    MCU_Write(mcu, 0xff80 | DEV_TMR_TCR, 0x09); // clear on compare match A, clock select 1
+}
+
+int main(int argc, char** argv)
+{
+    const uint64_t total_cycles = argc > 1 ? strtoull(argv[1], nullptr, 10) : 240000000;
+
+    // MCU cycles per TIMER_Clock call
+    const uint64_t strides[] = {12, 12 * 100, 12 * 10000};
+
+    const TestCase test = {Romset::MK2, 1, TestRom::SLEEP_LOOP};
+
+    RomsetInfo roms{};
+    MakeRoms(roms, test);
+
+    AllRomsetInfo all_info{};
+    all_info.romsets[(size_t)test.romset] = roms;
+
+    Emulator emu;
+    if (!emu.Init(EMU_Options{}) || !emu.LoadRoms(test.romset, all_info))
+    {
+        fprintf(stderr, "could not load roms\n");
+        return 1;
+    }
+    emu.Reset();
+
+    mcu_t& mcu = emu.GetMCU();
+    mcu_timer_t& timer = *mcu.timer;
+    SetupTimers(mcu);
+
+    for (uint64_t stride : strides)
+    {
+        const uint64_t num_calls = total_cycles / stride;
+        const uint64_t start_ticks = timer.cycles;
+
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < num_calls; i++)
+        {
+            mcu.cycles += stride;
+            TIMER_Clock(timer, mcu.cycles);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        printf("every %6llu cycles: %9.1f M ticks/s, %7.1f ns per call\n",
+               (unsigned long long)stride,
+               (double)(timer.cycles - start_ticks) / elapsed.count() / 1e6,
+               elapsed.count() * 1e9 / (double)num_calls);
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Times `unscramble` on a synthetic 2 MB waverom image. Not run as a test.
+#include "rom_io.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    const int size       = 0x200000;
+    const int iterations = argc > 1 ? atoi(argv[1]) : 50;
+
+    std::mt19937 rng(1);
+
+    std::vector<uint8_t> scrambled(size);
+    for (uint8_t& byte : scrambled)
+    {
+        byte = (uint8_t)rng();
+    }
+    std::vector<uint8_t> unscrambled(size);
+
+    // Warm up the caches and the page mappings of `unscrambled`
+    unscramble(scrambled.data(), unscrambled.data(), size);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        unscramble(scrambled.data(), unscrambled.data(), size);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("unscramble: %.3f ms per 2 MB image, %.1f MB/s\n",
+           elapsed.count() * 1000.0 / iterations,
+           (double)size * iterations / elapsed.count() / 1e6);
+    return 0;
+}
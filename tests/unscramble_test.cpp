@@ -0,0 +1,77 @@
+// Checks the table-driven `unscramble` against the original bit-by-bit implementation on random waverom images.
+#include "rom_io.h"
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <vector>
+
+// The original implementation, kept as the reference
+static void UnscrambleReference(const uint8_t* src, uint8_t* dst, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        int address = i & ~0xfffff;
+        static const int aa[] = {
+            2, 0, 3, 4, 1, 9, 13, 10, 18, 17, 6, 15, 11, 16, 8, 5, 12, 7, 14, 19
+        };
+        for (int j = 0; j < 20; j++)
+        {
+            if (i & (1 << j))
+                address |= 1<<aa[j];
+        }
+        uint8_t srcdata = src[address];
+        uint8_t data = 0;
+        static const int dd[] = {
+            2, 0, 4, 5, 7, 6, 3, 1
+        };
+        for (int j = 0; j < 8; j++)
+        {
+            if (srcdata & (1 << dd[j]))
+                data |= 1<<j;
+        }
+        dst[i] = data;
+    }
+}
+
+int main()
+{
+    // One and two banks; the largest waveroms are 2 MB
+    const int sizes[] = {0x100000, 0x200000};
+
+    size_t num_failed = 0;
+
+    for (int size : sizes)
+    {
+        std::mt19937 rng(size);
+
+        std::vector<uint8_t> scrambled((size_t)size);
+        for (uint8_t& byte : scrambled)
+        {
+            byte = (uint8_t)rng();
+        }
+
+        std::vector<uint8_t> expected((size_t)size);
+        std::vector<uint8_t> actual((size_t)size);
+        UnscrambleReference(scrambled.data(), expected.data(), size);
+        unscramble(scrambled.data(), actual.data(), size);
+
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            if (expected[i] != actual[i])
+            {
+                fprintf(stderr,
+                        "%d bytes: first mismatch at %zx: %02x vs %02x\n",
+                        size,
+                        i,
+                        actual[i],
+                        expected[i]);
+                num_failed++;
+                break;
+            }
+        }
+    }
+
+    printf("%zu of %zu sizes matched\n", std::size(sizes) - num_failed, std::size(sizes));
+    return num_failed == 0 ? 0 : 1;
+}